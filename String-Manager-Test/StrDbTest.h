@@ -0,0 +1,104 @@
+/******************************************************
+ - FileName
+    StrDbTest.h
+ - Description
+    Behavior tests of string database. Each test
+    runs on an empty database of its own, and
+    failed checks are printed with their places
+*******************************************************/
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+    Check a condition, and report it if it is false
+*/
+#define CHECK(Condition)    CheckCondition((Condition), #Condition, __FILE__, __LINE__)
+
+/*
+ - Description
+    Count a check, and print it if it is failed
+ - Input
+    bPassed: Whether the condition is true
+    lpCondition: The condition text
+    lpFileName: The source file of check
+    nLine: The source line of check
+*/
+void CheckCondition(bool bPassed, const char *lpCondition, const char *lpFileName, int nLine);
+
+/*
+    Tests of index table
+*/
+void TestIndexLayout();
+void TestIndexDefrag();
+
+/*
+    Tests of splicing strings
+*/
+void TestSpliceBounds();
+void TestSpliceInPlace();
+void TestSpliceMoved();
+
+/*
+    Tests of large string storage
+*/
+void TestLargeStorageTier();
+void TestLargeStorageDefrag();
+void TestLargeStorageFull();
+
+/*
+    Tests of cold string compression
+*/
+void TestCodecRoundTrip();
+void TestCodeMatcher();
+void TestCompressItems();
+
+/*
+    Tests of UTF-8 decoding and file loading
+*/
+void TestDecodeUtf8();
+void TestLoadLines();
+void TestLoadFull();
+void TestLoadFileName();
+
+/*
+    Tests of cached query results
+*/
+void TestQueryCacheHit();
+void TestQueryCacheInvalidate();
+void TestQueryCacheDefrag();
+
+/*
+    Tests of sharded front end
+*/
+void TestShardHandle();
+void TestShardScatter();
+void TestShardAlterAll();
+
+/*
+    Tests of binary protocol
+*/
+void TestProtocolIntegers();
+void TestFrameParse();
+
+/*
+    Tests of query modes
+*/
+void TestFoldString();
+void TestQueryModes();
+void TestShardQueryModes();
+
+/*
+    Tests of sketches
+*/
+void TestSketchDatabase();
+void TestSketchNGrams();
+void TestSketchBounds();
+
+/*
+    Tests of change feed
+*/
+void TestChangeEvents();
+void TestChangeCursorLost();
+void TestChangeMirror();
+void TestShardChangeFeed();
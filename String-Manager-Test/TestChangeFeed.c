@@ -0,0 +1,316 @@
+/******************************************************
+ - FileName
+    TestChangeFeed.c
+ - Description
+    Tests of change feed, which is tailed from a
+    cursor to mirror database from a snapshot
+*******************************************************/
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include "StrDb.h"
+#include "StrDbShard.h"
+#include "StrDbTest.h"
+
+// Events kept in ring, and characters of strings kept with them,
+// CHANGE_RING_SIZE and CHANGE_ARENA_SIZE of kernel
+#define RING_SIZE       1024
+#define ARENA_SIZE      (64 * 1024)
+
+// Strings kept by mirror, and their max length including '\0'
+#define MIRROR_COUNT    600
+#define MIRROR_LENGTH   256
+
+/*
+    Copy of database built from snapshot and changes
+*/
+typedef struct _Mirror
+{
+    size_t nSequence;
+    size_t nCount;
+    size_t nIds[MIRROR_COUNT];
+    wchar_t szStrings[MIRROR_COUNT][MIRROR_LENGTH];
+} Mirror;
+
+/*
+    Start mirror from a snapshot
+*/
+static void CopySnapshot(Mirror *lpMirror, const Snapshot *lpSnapshot)
+{
+    lpMirror->nSequence = lpSnapshot->nSequence;
+    lpMirror->nCount = lpSnapshot->nCount;
+    for (size_t i = 0; i != lpSnapshot->nCount; ++i)
+    {
+        lpMirror->nIds[i] = lpSnapshot->lpIds[i];
+        wcscpy(lpMirror->szStrings[i], lpSnapshot->lpStrings[i]);
+    }
+}
+
+/*
+    Insert a string into mirror at index
+*/
+static void InsertMirror(Mirror *lpMirror, size_t nIndex, size_t nId, const ChangeEvent *lpEvent)
+{
+    memmove(&lpMirror->nIds[nIndex + 1], &lpMirror->nIds[nIndex],
+        (lpMirror->nCount - nIndex) * sizeof(size_t));
+    memmove(lpMirror->szStrings[nIndex + 1], lpMirror->szStrings[nIndex],
+        (lpMirror->nCount - nIndex) * MIRROR_LENGTH * sizeof(wchar_t));
+    lpMirror->nIds[nIndex] = nId;
+    CHECK(ReadChangeData(lpEvent, lpMirror->szStrings[nIndex]) == true);
+    ++lpMirror->nCount;
+}
+
+/*
+    Remove the string at index from mirror
+*/
+static void RemoveMirror(Mirror *lpMirror, size_t nIndex)
+{
+    --lpMirror->nCount;
+    memmove(&lpMirror->nIds[nIndex], &lpMirror->nIds[nIndex + 1],
+        (lpMirror->nCount - nIndex) * sizeof(size_t));
+    memmove(lpMirror->szStrings[nIndex], lpMirror->szStrings[nIndex + 1],
+        (lpMirror->nCount - nIndex) * MIRROR_LENGTH * sizeof(wchar_t));
+}
+
+/*
+    Apply changes after the mirror sequence, returns false if cursor is lost
+*/
+static bool UpdateMirror(Mirror *lpMirror)
+{
+    ChangeEvent Events[16];
+    size_t nCount = 0;
+    while ((nCount = ReadChanges(lpMirror->nSequence, Events, 16)) != 0)
+    {
+        if (nCount == CHANGE_CURSOR_LOST)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i != nCount; ++i)
+        {
+            const ChangeEvent *lpEvent = &Events[i];
+            CHECK(lpEvent->nSequence == lpMirror->nSequence + 1);
+            lpMirror->nSequence = lpEvent->nSequence;
+            switch (lpEvent->nType)
+            {
+            case CHANGE_STORE:
+                CHECK(lpEvent->nIndex <= lpMirror->nCount);
+                InsertMirror(lpMirror, lpEvent->nIndex, lpEvent->nId, lpEvent);
+                break;
+
+            case CHANGE_DELETE:
+                CHECK(lpMirror->nIds[lpEvent->nIndex] == lpEvent->nId);
+                RemoveMirror(lpMirror, lpEvent->nIndex);
+                break;
+
+            case CHANGE_ALTER:
+                CHECK(lpMirror->nIds[lpEvent->nPreviousIndex] == lpEvent->nPreviousId);
+                RemoveMirror(lpMirror, lpEvent->nPreviousIndex);
+                InsertMirror(lpMirror, lpEvent->nIndex, lpEvent->nId, lpEvent);
+                break;
+
+            case CHANGE_CLEAR:
+                lpMirror->nCount = 0;
+                break;
+
+            default:
+                // Relocated strings keep their indexes and ids
+                CHECK(lpEvent->nType == CHANGE_RELOCATE);
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+    Check mirror is the same as database
+*/
+static void CheckMirror(const Mirror *lpMirror)
+{
+    CHECK(lpMirror->nSequence == GetChangeSequence());
+    CHECK(lpMirror->nCount == GetItemCount());
+    for (size_t i = 0; i != lpMirror->nCount && i != GetItemCount(); ++i)
+    {
+        CHECK(lpMirror->nIds[i] == GetItemId(i));
+        CHECK(wcscmp(lpMirror->szStrings[i], GetItem(i, NULL)) == 0);
+    }
+}
+
+/*
+    Events carry indexes, ids and strings of changes in sequence
+*/
+void TestChangeEvents()
+{
+    CHECK(GetChangeSequence() == 0);
+    CHECK(Store(L"one", NULL) == true);
+    CHECK(Store(L"two", NULL) == true);
+    size_t nOneId = GetItemId(0), nTwoId = GetItemId(1);
+    CHECK(AlterByIndex(0, L"ONE", NULL) == true);
+    CHECK(DeleteByIndex(1) == true);
+    ClearDatabase();
+
+    ChangeEvent Events[8];
+    CHECK(ReadChanges(0, Events, 8) == 5);
+    for (size_t i = 0; i != 5; ++i)
+    {
+        CHECK(Events[i].nSequence == i + 1);
+    }
+
+    wchar_t szBuffer[8];
+    CHECK(Events[0].nType == CHANGE_STORE && Events[0].nIndex == 0 && Events[0].nId == nOneId);
+    CHECK(Events[0].nLength == 4 && ReadChangeData(&Events[0], szBuffer) == true);
+    CHECK(wcscmp(szBuffer, L"one") == 0);
+    CHECK(Events[1].nType == CHANGE_STORE && Events[1].nIndex == 1 && Events[1].nId == nTwoId);
+
+    // Altered on the same place, so it keeps its index and id
+    CHECK(Events[2].nType == CHANGE_ALTER && Events[2].nIndex == 0 && Events[2].nPreviousIndex == 0);
+    CHECK(Events[2].nId == nOneId && Events[2].nPreviousId == nOneId);
+    CHECK(ReadChangeData(&Events[2], szBuffer) == true && wcscmp(szBuffer, L"ONE") == 0);
+
+    CHECK(Events[3].nType == CHANGE_DELETE && Events[3].nIndex == 1 && Events[3].nId == nTwoId);
+    CHECK(ReadChangeData(&Events[3], szBuffer) == false);
+    CHECK(Events[4].nType == CHANGE_CLEAR && Events[4].nId == SIZE_MAX);
+
+    // Reading from the middle and in pieces
+    CHECK(ReadChanges(3, Events, 8) == 2 && Events[0].nSequence == 4);
+    CHECK(ReadChanges(0, Events, 2) == 2 && Events[1].nSequence == 2);
+    CHECK(ReadChanges(5, Events, 8) == 0);
+    CHECK(ReadChanges(6, Events, 8) == 0);
+}
+
+/*
+    Cursors behind the ring are lost, and strings overwritten in arena
+    can not be read
+*/
+void TestChangeCursorLost()
+{
+    ChangeEvent First, Event;
+    CHECK(Store(L"first", NULL) == true);
+    CHECK(ReadChanges(0, &First, 1) == 1);
+
+    // Each round publishes a store and a delete, and strings stored
+    // are more than arena can keep
+    wchar_t szString[201];
+    wmemset(szString, L'x', 200);
+    szString[200] = L'\0';
+    for (size_t i = 0; i != RING_SIZE / 2; ++i)
+    {
+        CHECK(Store(szString, NULL) == true);
+        CHECK(DeleteByIndex(1) == true);
+    }
+
+    CHECK(RING_SIZE / 2 * 201 > ARENA_SIZE);
+    size_t nSequence = GetChangeSequence();
+    CHECK(nSequence == RING_SIZE + 1);
+    CHECK(ReadChanges(0, &Event, 1) == CHANGE_CURSOR_LOST);
+    CHECK(ReadChanges(1, &Event, 1) == 1 && Event.nSequence == 2);
+    CHECK(ReadChanges(nSequence - 1, &Event, 1) == 1 && Event.nType == CHANGE_DELETE);
+
+    // Events in ring may carry strings overwritten in arena
+    wchar_t szBuffer[201];
+    CHECK(ReadChangeData(&First, szBuffer) == false);
+    CHECK(ReadChanges(1, &Event, 1) == 1);
+    CHECK(Event.nType == CHANGE_STORE && ReadChangeData(&Event, szBuffer) == false);
+
+    ChangeEvent Latest[2];
+    CHECK(ReadChanges(nSequence - 2, Latest, 2) == 2);
+    CHECK(Latest[0].nType == CHANGE_STORE && ReadChangeData(&Latest[0], szBuffer) == true);
+    CHECK(wcscmp(szBuffer, szString) == 0);
+}
+
+/*
+    Mirror copied from snapshot and updated by changes is the same as
+    database, through splices, moves, defragment and clearing
+*/
+void TestChangeMirror()
+{
+    static Mirror Copy;
+    wchar_t szString[128];
+    for (size_t i = 0; i != 10; ++i)
+    {
+        swprintf(szString, 128, L"%zu", i);
+        wmemset(&szString[1], L'x', 96);
+        szString[97] = L'\0';
+        CHECK(Store(szString, NULL) == true);
+    }
+
+    Snapshot *lpSnapshot = TakeSnapshot();
+    CHECK(lpSnapshot != NULL);
+    if (lpSnapshot == NULL)
+    {
+        return;
+    }
+
+    CHECK(lpSnapshot->nSequence == 10 && lpSnapshot->nCount == 10);
+    CopySnapshot(&Copy, lpSnapshot);
+    FreeSnapshot(lpSnapshot);
+    CheckMirror(&Copy);
+
+    // Moved by growing with defragment, published as one alter and a relocation
+    CHECK(DeleteByIndex(0) == true);
+    size_t nSequence = GetChangeSequence();
+    wmemset(szString, L'z', 120);
+    szString[120] = L'\0';
+    size_t nId = GetItemId(3), nNewIndex = 0;
+    CHECK(AlterByIndex(3, szString, &nNewIndex) == true);
+
+    ChangeEvent Events[4];
+    CHECK(ReadChanges(nSequence, Events, 4) == 2);
+    CHECK(Events[0].nType == CHANGE_ALTER && Events[0].nPreviousIndex == 3);
+    CHECK(Events[0].nPreviousId == nId && Events[0].nId == GetItemId(nNewIndex));
+    CHECK(Events[0].nIndex == nNewIndex && Events[1].nType == CHANGE_RELOCATE);
+
+    CHECK(UpdateMirror(&Copy) == true);
+    CheckMirror(&Copy);
+
+    CHECK(AppendToItem(0, L"-tail", NULL) == true);
+    CHECK(InsertAtOffset(2, 0, L"head-", NULL) == true);
+    CHECK(EraseRange(4, 0, 10, NULL) == true);
+    CHECK(Store(L"new", NULL) == true);
+    CHECK(DeleteAllByContent(L"new") == 1);
+    DefragDatabase();
+    CHECK(UpdateMirror(&Copy) == true);
+    CheckMirror(&Copy);
+
+    ClearDatabase();
+    CHECK(Store(L"after clear", NULL) == true);
+    CHECK(UpdateMirror(&Copy) == true);
+    CheckMirror(&Copy);
+}
+
+/*
+    Shard feeds carry handles, which find strings of their shards
+*/
+void TestShardChangeFeed()
+{
+    CHECK(InitShards() == true);
+
+    ShardHandle hItem = 0;
+    CHECK(ShardStore(L"shard string", &hItem) == true);
+    size_t nShard = hItem & (SHARD_COUNT - 1);
+    CHECK(ShardGetChangeSequence(nShard) == 1);
+
+    ChangeEvent Event;
+    wchar_t szBuffer[16];
+    CHECK(ShardReadChanges(nShard, 0, &Event, 1) == 1);
+    CHECK(Event.nType == CHANGE_STORE && Event.nId == hItem);
+    CHECK(ShardReadChangeData(nShard, &Event, szBuffer) == true);
+    CHECK(wcscmp(szBuffer, L"shard string") == 0);
+
+    Snapshot *lpSnapshot = ShardTakeSnapshot(nShard);
+    CHECK(lpSnapshot != NULL);
+    if (lpSnapshot != NULL)
+    {
+        CHECK(lpSnapshot->nSequence == 1 && lpSnapshot->nCount == 1);
+        CHECK(lpSnapshot->nCount == 1 && lpSnapshot->lpIds[0] == hItem);
+        FreeSnapshot(lpSnapshot);
+    }
+
+    CHECK(ShardDeleteByHandle(hItem) == true);
+    CHECK(ShardReadChanges(nShard, 1, &Event, 1) == 1);
+    CHECK(Event.nType == CHANGE_DELETE && Event.nId == hItem);
+
+    ReleaseShards();
+}
@@ -0,0 +1,191 @@
+/******************************************************
+ - FileName
+    TestCompress.c
+ - Description
+    Tests of cold string compression by shared
+    dictionary, and of searching codes
+*******************************************************/
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include "StrDb.h"
+#include "StrDbCodec.h"
+#include "StrDbTest.h"
+
+/*
+    Next pseudo random number, the same in every run
+*/
+static uint32_t NextRandom(uint32_t *lpSeed)
+{
+    *lpSeed = *lpSeed * 1103515245u + 12345u;
+    return *lpSeed >> 16;
+}
+
+/*
+    Strings are decoded to what they are encoded from, including characters
+    not in dictionary
+*/
+void TestCodecRoundTrip()
+{
+    static SymbolTable Table;
+    static const wchar_t szSamples[] = L"http://example.com/index\0"
+        L"http://example.com/search?q=1\0http://example.org/about\0";
+    CHECK(TrainSymbolTable(&Table, szSamples, sizeof(szSamples) / sizeof(wchar_t) - 1) == true);
+    CHECK(Table.nCount > 0);
+
+    static const wchar_t *Strings[] =
+    {
+        L"", L"h", L"http://example.com/", L"HTTP://EXAMPLE.COM/",
+        L"caf\x00E9 \x4E2D\x6587", L"\xFFFD\x00FF\x0100", L"http://example.com/\x00E9",
+    };
+
+    for (size_t i = 0; i != sizeof(Strings) / sizeof(Strings[0]); ++i)
+    {
+        uint8_t Codes[256];
+        wchar_t szDecoded[64];
+        size_t nLength = wcslen(Strings[i]);
+        size_t nCodeSize = EncodeString(&Table, Strings[i], nLength, Codes, sizeof(Codes));
+        CHECK(nCodeSize != 0 || nLength == 0);
+        CHECK(DecodeString(&Table, Codes, nCodeSize, szDecoded, 64) == nLength);
+        CHECK(wmemcmp(szDecoded, Strings[i], nLength) == 0);
+    }
+
+    // Repeated text is shorter than its characters
+    uint8_t Codes[256];
+    const wchar_t *lpUrl = L"http://example.com/index";
+    CHECK(EncodeString(&Table, lpUrl, wcslen(lpUrl), Codes, sizeof(Codes)) < wcslen(lpUrl));
+    CHECK(EncodeString(&Table, lpUrl, wcslen(lpUrl), Codes, 1) == 0);
+}
+
+/*
+    Searching codes finds the same strings as searching characters
+*/
+void TestCodeMatcher()
+{
+    static SymbolTable Table;
+    static CodeMatcher Matcher;
+    uint32_t nSeed = 1;
+    wchar_t szSamples[2000];
+    for (size_t i = 0; i != 2000; ++i)
+    {
+        szSamples[i] = (i % 50 == 49) ? L'\0' : L"abc"[NextRandom(&nSeed) % 3];
+    }
+
+    CHECK(TrainSymbolTable(&Table, szSamples, 2000) == true);
+
+    size_t nMismatches = 0;
+    for (size_t i = 0; i != 20000; ++i)
+    {
+        wchar_t szString[40], szPattern[8];
+        size_t nLength = NextRandom(&nSeed) % 40;
+        size_t nPatternLength = NextRandom(&nSeed) % 6;
+        for (size_t j = 0; j != nLength; ++j)
+        {
+            szString[j] = L"abcd"[NextRandom(&nSeed) % 4];
+        }
+
+        for (size_t j = 0; j != nPatternLength; ++j)
+        {
+            szPattern[j] = L"abcd"[NextRandom(&nSeed) % 4];
+        }
+
+        szString[nLength] = L'\0';
+        szPattern[nPatternLength] = L'\0';
+
+        uint8_t Codes[400];
+        size_t nCodeSize = EncodeString(&Table, szString, nLength, Codes, sizeof(Codes));
+        if (InitCodeMatcher(&Matcher, &Table, szPattern, nPatternLength) == false
+            || MatchCodes(&Matcher, Codes, nCodeSize) != (wcsstr(szString, szPattern) != NULL))
+        {
+            ++nMismatches;
+        }
+    }
+
+    CHECK(nMismatches == 0);
+
+    wchar_t szLong[MATCHER_MAX_LENGTH + 2];
+    wmemset(szLong, L'a', MATCHER_MAX_LENGTH + 1);
+    szLong[MATCHER_MAX_LENGTH + 1] = L'\0';
+    CHECK(InitCodeMatcher(&Matcher, &Table, szLong, MATCHER_MAX_LENGTH + 1) == false);
+}
+
+/*
+    Compressed strings read, query and count the same as before, and their
+    pointers are kept until database is changed
+*/
+void TestCompressItems()
+{
+    static const wchar_t *Words[] =
+    {
+        L"abcabcabd", L"aaaab", L"hello there", L"the quick brown fox",
+        L"abababac", L"xyz123XYZ", L"Zzz99",
+    };
+
+    const size_t nWordCount = sizeof(Words) / sizeof(Words[0]);
+    for (size_t i = 0; i != nWordCount * 4; ++i)
+    {
+        CHECK(Store(Words[i % nWordCount], NULL) == true);
+    }
+
+    static const wchar_t *Keys[] =
+    {
+        L"a", L"abd", L"abab", L"ababac", L"cab", L"there", L"quick brown",
+        L"z1", L"zz9", L"nothing", L"abcabcabd", L"abcabcabdx",
+    };
+
+    const size_t nKeyCount = sizeof(Keys) / sizeof(Keys[0]);
+    size_t Before[62] = { 0 }, After[62] = { 0 }, nTotalBefore = 0, nTotalAfter = 0;
+    CHECK(Statistic(Before, 62, &nTotalBefore) == true);
+
+    CHECK(CompressColdItems(0) == nWordCount * 4);
+    CHECK(GetCompressedCount() == nWordCount * 4);
+    CHECK(TrainDictionary() == false);
+
+    CHECK(Statistic(After, 62, &nTotalAfter) == true);
+    CHECK(nTotalBefore == nTotalAfter);
+    CHECK(memcmp(Before, After, sizeof(Before)) == 0);
+
+    // Decompressed strings are kept for later reads
+    const wchar_t *Pointers[sizeof(Words) / sizeof(Words[0]) * 4];
+    for (size_t i = 0; i != nWordCount * 4; ++i)
+    {
+        size_t nLength = 0;
+        Pointers[i] = GetItem(i, &nLength);
+        CHECK(Pointers[i] != NULL && wcscmp(Pointers[i], Words[i % nWordCount]) == 0);
+        CHECK(nLength == wcslen(Words[i % nWordCount]) + 1);
+    }
+
+    for (size_t i = 0; i != nWordCount * 4; ++i)
+    {
+        CHECK(GetItem(i, NULL) == Pointers[i]);
+        CHECK(wcscmp(Pointers[i], Words[i % nWordCount]) == 0);
+    }
+
+    // Keys are not queried before, so codes are searched instead of cache
+    for (size_t i = 0; i != nKeyCount; ++i)
+    {
+        size_t nExpectedCount = 0;
+        for (size_t j = 0; j != nWordCount; ++j)
+        {
+            nExpectedCount += (wcsstr(Words[j], Keys[i]) != NULL) ? 4 : 0;
+        }
+
+        size_t nMatchCount = 0;
+        const QueryRecord *lpRecords = FuzzyQueryAllByContent(Keys[i], &nMatchCount);
+        CHECK(nMatchCount == nExpectedCount);
+        for (size_t j = 0; j != nMatchCount; ++j)
+        {
+            CHECK(wcsstr(lpRecords[j].lpData, Keys[i]) != NULL);
+        }
+    }
+
+    size_t nMatchCount = 0;
+    const QueryRecord *lpRecords = QueryAllByContent(L"hello there", &nMatchCount);
+    CHECK(nMatchCount == 4);
+    CHECK(nMatchCount != 0 && wcscmp(lpRecords[0].lpData, L"hello there") == 0);
+
+    // Splicing stores the string uncompressed
+    CHECK(AppendToItem(0, L"!", NULL) == true);
+    CHECK(GetCompressedCount() == nWordCount * 4 - 1);
+    CHECK(QueryNextByContent(L"abcabcabd!", 0, NULL) != NULL);
+}
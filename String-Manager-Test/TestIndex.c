@@ -0,0 +1,89 @@
+/******************************************************
+ - FileName
+    TestIndex.c
+ - Description
+    Tests of index table, whose entries locate
+    strings by 32-bit offsets and lengths
+*******************************************************/
+#include <wchar.h>
+#include "StrDb.h"
+#include "StrDbTest.h"
+
+/*
+    Strings are located by offsets and lengths until storage is full
+*/
+void TestIndexLayout()
+{
+    wchar_t szString[16];
+    size_t nCount = 0;
+    size_t nUsedSize = 0;
+    for (;;)
+    {
+        swprintf(szString, 16, L"s%zu", nCount);
+        size_t nIndex = 0;
+        if (Store(szString, &nIndex) == false)
+        {
+            break;
+        }
+
+        CHECK(nIndex == nCount);
+        nUsedSize += wcslen(szString) + 1;
+        ++nCount;
+    }
+
+    // Storage is filled up, with no gap between strings
+    CHECK(nCount == GetItemCount());
+    CHECK(GetUsedSize() == nUsedSize);
+    CHECK(GetFreeSize() < wcslen(szString) + 1);
+
+    for (size_t i = 0; i != nCount; ++i)
+    {
+        swprintf(szString, 16, L"s%zu", i);
+        size_t nLength = 0;
+        const wchar_t *lpString = GetItem(i, &nLength);
+        CHECK(lpString != NULL && wcscmp(lpString, szString) == 0);
+        CHECK(nLength == wcslen(szString) + 1);
+    }
+
+    size_t nMatchIndex = 0;
+    CHECK(QueryNextByContent(L"s7", 0, &nMatchIndex) != NULL && nMatchIndex == 7);
+    CHECK(GetItem(nCount, NULL) == NULL);
+}
+
+/*
+    Defragment moves strings and their offsets together
+*/
+void TestIndexDefrag()
+{
+    wchar_t szString[16];
+    for (size_t i = 0; i != 20; ++i)
+    {
+        swprintf(szString, 16, L"item-%zu", i);
+        CHECK(Store(szString, NULL) == true);
+    }
+
+    // Delete even strings, and leave holes between odd ones
+    for (size_t i = 0; i != 10; ++i)
+    {
+        CHECK(DeleteByIndex(i) == true);
+    }
+
+    size_t nUsedSize = GetUsedSize();
+    DefragDatabase();
+    CHECK(GetItemCount() == 10);
+    CHECK(GetUsedSize() == nUsedSize);
+    for (size_t i = 0; i != 10; ++i)
+    {
+        swprintf(szString, 16, L"item-%zu", i * 2 + 1);
+        const wchar_t *lpString = GetItem(i, NULL);
+        CHECK(lpString != NULL && wcscmp(lpString, szString) == 0);
+    }
+
+    // Strings are packed one next to one from the beginning
+    for (size_t i = 0; i + 1 != GetItemCount(); ++i)
+    {
+        size_t nLength = 0;
+        const wchar_t *lpString = GetItem(i, &nLength);
+        CHECK(lpString + nLength == GetItem(i + 1, NULL));
+    }
+}
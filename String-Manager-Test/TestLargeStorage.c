@@ -0,0 +1,123 @@
+/******************************************************
+ - FileName
+    TestLargeStorage.c
+ - Description
+    Tests of large string storage, whose strings
+    are kept in extents and never moved
+*******************************************************/
+#include <wchar.h>
+#include "StrDb.h"
+#include "StrDbTest.h"
+
+// Characters of each extent in large storage, EXTENT_SIZE of kernel
+#define EXTENT_CHARS    64
+
+/*
+    Make a string of repeated character
+*/
+static const wchar_t *RepeatChar(wchar_t *lpBuffer, wchar_t Char, size_t nLength)
+{
+    wmemset(lpBuffer, Char, nLength);
+    lpBuffer[nLength] = L'\0';
+    return lpBuffer;
+}
+
+/*
+    Strings longer than threshold are stored in whole extents, behind
+    small strings in index table
+*/
+void TestLargeStorageTier()
+{
+    wchar_t szString[1024];
+    CHECK(Store(RepeatChar(szString, L'a', 127), NULL) == true);
+    CHECK(GetUsedSize() == 128);
+    CHECK(GetLargeUsedSize() == 0);
+
+    size_t nIndex = 0;
+    CHECK(Store(RepeatChar(szString, L'b', 200), &nIndex) == true);
+    CHECK(nIndex == 1);
+    CHECK(GetUsedSize() == 128);
+    CHECK(GetLargeUsedSize() == 4 * EXTENT_CHARS);
+    CHECK(GetLargeFreeSize() == GetLargeTotalSize() - 4 * EXTENT_CHARS);
+
+    // Small strings are inserted before large ones
+    CHECK(Store(L"small", &nIndex) == true);
+    CHECK(nIndex == 1);
+    CHECK(wcscmp(GetItem(2, NULL), RepeatChar(szString, L'b', 200)) == 0);
+
+    SetLargeStringThreshold(16);
+    CHECK(Store(RepeatChar(szString, L'c', 20), &nIndex) == true);
+    CHECK(nIndex == 3);
+    CHECK(GetLargeUsedSize() == 5 * EXTENT_CHARS);
+
+    CHECK(DeleteByIndex(2) == true);
+    CHECK(GetLargeUsedSize() == EXTENT_CHARS);
+    CHECK(GetItemCount() == 3);
+}
+
+/*
+    Defragment and deleting small strings never move large strings
+*/
+void TestLargeStorageDefrag()
+{
+    wchar_t szString[1024];
+    for (size_t i = 0; i != 10; ++i)
+    {
+        swprintf(szString, 1024, L"small-%zu", i);
+        CHECK(Store(szString, NULL) == true);
+    }
+
+    size_t nIndex = 0;
+    CHECK(Store(RepeatChar(szString, L'x', 300), &nIndex) == true);
+    const wchar_t *lpLarge = GetItem(nIndex, NULL);
+    size_t nId = GetItemId(nIndex);
+
+    for (size_t i = 0; i != 5; ++i)
+    {
+        CHECK(DeleteByIndex(i) == true);
+    }
+
+    DefragDatabase();
+    nIndex = GetIndexById(nId);
+    CHECK(nIndex == 5);
+    CHECK(GetItem(nIndex, NULL) == lpLarge);
+    CHECK(wcscmp(lpLarge, RepeatChar(szString, L'x', 300)) == 0);
+}
+
+/*
+    Large strings never spill into small storage when extents run out,
+    and extents released are reused
+*/
+void TestLargeStorageFull()
+{
+    wchar_t szString[1024];
+    size_t nExtentCount = GetLargeTotalSize() / EXTENT_CHARS;
+    SetLargeStringThreshold(16);
+
+    // Each string takes two extents
+    size_t nCount = 0;
+    while (Store(RepeatChar(szString, L'a' + nCount % 26, EXTENT_CHARS + 1), NULL) == true)
+    {
+        ++nCount;
+    }
+
+    CHECK(nCount == nExtentCount / 2);
+    CHECK(GetLargeFreeSize() == 0);
+    CHECK(GetUsedSize() == 0);
+
+    // Free two extents apart, which can not hold a string of three extents
+    CHECK(DeleteByIndex(0) == true);
+    CHECK(DeleteByIndex(1) == true);
+    CHECK(GetLargeFreeSize() == 4 * EXTENT_CHARS);
+    CHECK(Store(RepeatChar(szString, L'z', EXTENT_CHARS * 2 + 1), NULL) == false);
+    CHECK(GetUsedSize() == 0);
+
+    CHECK(Store(RepeatChar(szString, L'y', EXTENT_CHARS * 2 - 1), NULL) == true);
+    CHECK(Store(RepeatChar(szString, L'z', EXTENT_CHARS * 2 - 1), NULL) == true);
+    CHECK(GetLargeFreeSize() == 0);
+    CHECK(GetItemCount() == nCount);
+
+    // Small strings are still stored in small storage
+    CHECK(Store(L"small", NULL) == true);
+    CHECK(GetUsedSize() == 6);
+}
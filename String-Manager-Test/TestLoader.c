@@ -0,0 +1,202 @@
+/******************************************************
+ - FileName
+    TestLoader.c
+ - Description
+    Tests of UTF-8 decoding and of loading strings
+    from mapped files
+*******************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include "StrDb.h"
+#include "StrDbCodec.h"
+#include "StrDbTest.h"
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+/*
+    Check UTF-8 text is decoded to the expected string
+*/
+static void CheckDecode(const char *lpText, size_t nSize, const wchar_t *lpExpected)
+{
+    wchar_t szString[32];
+    size_t nLength = DecodeUtf8((const uint8_t *)lpText, nSize, szString, 32);
+    CHECK(nLength == wcslen(lpExpected));
+    CHECK(nLength != SIZE_MAX && wmemcmp(szString, lpExpected, wcslen(lpExpected)) == 0);
+}
+
+/*
+    Open a file by its name, which is UTF-8 on POSIX
+*/
+static FILE *OpenFile(const wchar_t *lpFileName, const wchar_t *lpMode)
+{
+#ifdef _WIN32
+    return _wfopen(lpFileName, lpMode);
+#else
+    char szFileName[256], szMode[8];
+    size_t nSize = EncodeUtf8(lpFileName, wcslen(lpFileName), (uint8_t *)szFileName, 255);
+    size_t nModeSize = EncodeUtf8(lpMode, wcslen(lpMode), (uint8_t *)szMode, 7);
+    if (nSize == SIZE_MAX || nModeSize == SIZE_MAX)
+    {
+        return NULL;
+    }
+
+    szFileName[nSize] = '\0';
+    szMode[nModeSize] = '\0';
+    return fopen(szFileName, szMode);
+#endif
+}
+
+/*
+    Delete a file by its name
+*/
+static void RemoveFile(const wchar_t *lpFileName)
+{
+#ifdef _WIN32
+    _wremove(lpFileName);
+#else
+    char szFileName[256];
+    size_t nSize = EncodeUtf8(lpFileName, wcslen(lpFileName), (uint8_t *)szFileName, 255);
+    if (nSize != SIZE_MAX)
+    {
+        szFileName[nSize] = '\0';
+        remove(szFileName);
+    }
+#endif
+}
+
+/*
+    Write a file and load strings from it
+*/
+static bool LoadText(const wchar_t *lpFileName, const char *lpText, size_t nSize, LoadResult *lpResult)
+{
+    FILE *lpFile = OpenFile(lpFileName, L"wb");
+    CHECK(lpFile != NULL);
+    if (lpFile == NULL)
+    {
+        return false;
+    }
+
+    fwrite(lpText, 1, nSize, lpFile);
+    fclose(lpFile);
+
+    bool bLoaded = LoadFromFile(lpFileName, lpResult);
+    RemoveFile(lpFileName);
+    return bLoaded;
+}
+
+/*
+    Overlong forms, surrogates, values above U+10FFFF and broken sequences
+    are decoded as U+FFFD, one for each invalid byte
+*/
+void TestDecodeUtf8()
+{
+    CheckDecode("abc", 3, L"abc");
+    CheckDecode("\xC3\xA9", 2, L"\x00E9");
+    CheckDecode("\xE4\xB8\xAD", 3, L"\x4E2D");
+    CheckDecode("\xED\x9F\xBF", 3, L"\xD7FF");
+    CheckDecode("\xEF\xBF\xBD", 3, L"\xFFFD");
+
+    CheckDecode("\xC0\x80", 2, L"\xFFFD\xFFFD");
+    CheckDecode("\xC1\xBF", 2, L"\xFFFD\xFFFD");
+    CheckDecode("\xE0\x80\x80", 3, L"\xFFFD\xFFFD\xFFFD");
+    CheckDecode("\xED\xA0\x80", 3, L"\xFFFD\xFFFD\xFFFD");
+    CheckDecode("\xF0\x80\x80\x80", 4, L"\xFFFD\xFFFD\xFFFD\xFFFD");
+    CheckDecode("\xF4\x90\x80\x80", 4, L"\xFFFD\xFFFD\xFFFD\xFFFD");
+    CheckDecode("\xF5\x80", 2, L"\xFFFD\xFFFD");
+    CheckDecode("\xF7\xBF\xBF\xBF", 4, L"\xFFFD\xFFFD\xFFFD\xFFFD");
+    CheckDecode("\xFF", 1, L"\xFFFD");
+
+    // A broken sequence does not swallow the valid byte behind it
+    CheckDecode("\xE2\x82" "a", 3, L"\xFFFD" L"a");
+    CheckDecode("\xC3", 1, L"\xFFFD");
+    CheckDecode("\x80" "a", 2, L"\xFFFD" L"a");
+
+    // Characters above U+FFFF are one wchar_t or a surrogate pair
+    wchar_t szString[4];
+    size_t nLength = DecodeUtf8((const uint8_t *)"\xF4\x8F\xBF\xBF", 4, szString, 4);
+    CHECK(nLength == ((sizeof(wchar_t) == 2) ? 2 : 1));
+    if (sizeof(wchar_t) != 2)
+    {
+        CHECK(nLength == 1 && (uint32_t)szString[0] == 0x10FFFF);
+    }
+
+    CHECK(DecodeUtf8((const uint8_t *)"abc", 3, szString, 2) == SIZE_MAX);
+}
+
+/*
+    Lines are separated by '\n', "\r\n" or '\0', and BOM and empty lines
+    are skipped
+*/
+void TestLoadLines()
+{
+    static const char szText[] = "\xEF\xBB\xBF" "first\r\nsecond\n\n\r\ncaf\xC3\xA9\0bad\xC0\x80\nlast";
+    LoadResult Result;
+    CHECK(LoadText(L"StrDbTest-lines.txt", szText, sizeof(szText) - 1, &Result) == true);
+    CHECK(Result.nLoadCount == 5);
+    CHECK(Result.nDropCount == 0);
+    CHECK(Result.nByteCount == sizeof(szText) - 1);
+
+    static const wchar_t *Expected[] =
+    {
+        L"first", L"second", L"caf\x00E9", L"bad\xFFFD\xFFFD", L"last",
+    };
+
+    CHECK(GetItemCount() == 5);
+    for (size_t i = 0; i != 5; ++i)
+    {
+        const wchar_t *lpString = GetItem(i, NULL);
+        CHECK(lpString != NULL && wcscmp(lpString, Expected[i]) == 0);
+    }
+
+    CHECK(QueryNextByContent(L"caf\x00E9", 0, NULL) != NULL);
+    CHECK(LoadFromFile(L"StrDbTest-missing.txt", &Result) == false);
+}
+
+/*
+    Long lines are stored as large strings, and lines are dropped when
+    there is no space
+*/
+void TestLoadFull()
+{
+    static char szText[64 * 1024];
+    size_t nSize = 0;
+    memset(&szText[nSize], 'L', 300);
+    nSize += 300;
+    szText[nSize++] = '\n';
+
+    size_t nLineCount = 1;
+    for (size_t i = 0; i != 2000; ++i)
+    {
+        nSize += sprintf(&szText[nSize], "line-%zu\n", i);
+        ++nLineCount;
+    }
+
+    LoadResult Result;
+    CHECK(LoadText(L"StrDbTest-full.txt", szText, nSize, &Result) == true);
+    CHECK(Result.nLoadCount + Result.nDropCount == nLineCount);
+    CHECK(Result.nDropCount != 0);
+    CHECK(Result.nLoadCount == GetItemCount());
+    CHECK(GetLargeUsedSize() != 0);
+
+    CHECK(QueryNextByContent(L"line-0", 0, NULL) != NULL);
+    CHECK(QueryNextByContent(L"line-1999", 0, NULL) == NULL);
+
+    // Large strings are behind small strings
+    const wchar_t *lpLarge = GetItem(GetItemCount() - 1, NULL);
+    CHECK(lpLarge != NULL && wcslen(lpLarge) == 300);
+}
+
+/*
+    Files are found by names with non-ASCII characters
+*/
+void TestLoadFileName()
+{
+    LoadResult Result;
+    CHECK(LoadText(L"StrDbTest-caf\x00E9-\x4E2D.txt", "one\ntwo\n", 8, &Result) == true);
+    CHECK(Result.nLoadCount == 2);
+    CHECK(GetItemCount() == 2 && wcscmp(GetItem(1, NULL), L"two") == 0);
+}
@@ -0,0 +1,78 @@
+/******************************************************
+ - FileName
+    TestProtocol.c
+ - Description
+    Tests of binary protocol between server and
+    clients, its integers and frames
+*******************************************************/
+#include <stdint.h>
+#include <string.h>
+#include "StrDbProtocol.h"
+#include "StrDbTest.h"
+
+/*
+    Integers are little endian
+*/
+void TestProtocolIntegers()
+{
+    uint8_t Buffer[8];
+    PutUint32(Buffer, 0x12345678u);
+    CHECK(Buffer[0] == 0x78 && Buffer[1] == 0x56 && Buffer[2] == 0x34 && Buffer[3] == 0x12);
+    CHECK(GetUint32(Buffer) == 0x12345678u);
+
+    PutUint64(Buffer, 0xFEDCBA9876543210u);
+    CHECK(Buffer[0] == 0x10 && Buffer[7] == 0xFE);
+    CHECK(GetUint64(Buffer) == 0xFEDCBA9876543210u);
+
+    PutUint64(Buffer, UINT64_MAX);
+    CHECK(GetUint64(Buffer) == UINT64_MAX);
+    CHECK(GetUint32(Buffer) == UINT32_MAX);
+}
+
+/*
+    Frames are complete only when all their bytes are received, and sizes
+    out of range are rejected before they are received
+*/
+void TestFrameParse()
+{
+    uint8_t Buffer[64];
+    size_t nSize = PutFrameHeader(Buffer, 7, OP_STORE, 3);
+    CHECK(nSize == FRAME_HEADER_SIZE);
+    memcpy(&Buffer[nSize], "abc", 3);
+    nSize += 3;
+
+    // The next request is pipelined behind, with no payload
+    size_t nSecondSize = PutFrameHeader(&Buffer[nSize], 8, OP_STATISTIC, 0);
+
+    size_t nFrameSize = 0;
+    for (size_t i = 0; i != nSize; ++i)
+    {
+        CHECK(ParseFrame(Buffer, i, &nFrameSize) == FRAME_PARTIAL);
+    }
+
+    CHECK(ParseFrame(Buffer, nSize, &nFrameSize) == FRAME_COMPLETE);
+    CHECK(nFrameSize == FRAME_HEADER_SIZE - 4 + 3);
+    CHECK(GetUint32(&Buffer[4]) == 7 && Buffer[8] == OP_STORE);
+    CHECK(memcmp(&Buffer[FRAME_HEADER_SIZE], "abc", 3) == 0);
+
+    CHECK(ParseFrame(Buffer, nSize + nSecondSize, &nFrameSize) == FRAME_COMPLETE);
+    CHECK(nFrameSize == FRAME_HEADER_SIZE - 4 + 3);
+    CHECK(ParseFrame(&Buffer[nSize], nSecondSize - 1, &nFrameSize) == FRAME_PARTIAL);
+    CHECK(ParseFrame(&Buffer[nSize], nSecondSize, &nFrameSize) == FRAME_COMPLETE);
+    CHECK(nFrameSize == FRAME_HEADER_SIZE - 4);
+    CHECK(GetUint32(&Buffer[nSize + 4]) == 8 && Buffer[nSize + 8] == OP_STATISTIC);
+
+    // Frames without id and code
+    PutUint32(Buffer, 0);
+    CHECK(ParseFrame(Buffer, 4, &nFrameSize) == FRAME_INVALID);
+    PutUint32(Buffer, FRAME_HEADER_SIZE - 5);
+    CHECK(ParseFrame(Buffer, 64, &nFrameSize) == FRAME_INVALID);
+
+    // The largest frame waits for its bytes, a larger one is rejected at once
+    PutUint32(Buffer, MAX_FRAME_SIZE);
+    CHECK(ParseFrame(Buffer, 64, &nFrameSize) == FRAME_PARTIAL);
+    PutUint32(Buffer, MAX_FRAME_SIZE + 1);
+    CHECK(ParseFrame(Buffer, 4, &nFrameSize) == FRAME_INVALID);
+    PutUint32(Buffer, UINT32_MAX);
+    CHECK(ParseFrame(Buffer, 4, &nFrameSize) == FRAME_INVALID);
+}
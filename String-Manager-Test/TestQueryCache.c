@@ -0,0 +1,153 @@
+/******************************************************
+ - FileName
+    TestQueryCache.c
+ - Description
+    Tests of cached query results, which are valid
+    while database version is not changed
+*******************************************************/
+#include <wchar.h>
+#include "StrDb.h"
+#include "StrDbTest.h"
+
+// Max memory of cached results, QUERY_CACHE_MEMORY of kernel
+#define CACHE_MEMORY    (64 * 1024)
+
+/*
+    Check records of a query point to their strings
+*/
+static void CheckRecords(const QueryRecord *lpRecords, size_t nMatchCount,
+    const wchar_t *lpString, bool bFuzzy)
+{
+    for (size_t i = 0; i != nMatchCount; ++i)
+    {
+        CHECK(lpRecords[i].lpData == GetItem(lpRecords[i].nIndex, NULL));
+        if (bFuzzy == true)
+        {
+            CHECK(wcsstr(lpRecords[i].lpData, lpString) != NULL);
+        }
+        else
+        {
+            CHECK(wcscmp(lpRecords[i].lpData, lpString) == 0);
+        }
+    }
+}
+
+/*
+    Repeated queries return the same results from cache, exact and fuzzy
+    results are cached apart
+*/
+void TestQueryCacheHit()
+{
+    CHECK(Store(L"apple", NULL) == true);
+    CHECK(Store(L"pineapple", NULL) == true);
+    CHECK(Store(L"apple", NULL) == true);
+    CHECK(GetQueryCacheMemory() == 0);
+
+    size_t nVersion = GetDatabaseVersion();
+    size_t nMatchCount = 0;
+    const QueryRecord *lpRecords = QueryAllByContent(L"apple", &nMatchCount);
+    CHECK(nMatchCount == 2);
+    CheckRecords(lpRecords, nMatchCount, L"apple", false);
+    size_t nMemory = GetQueryCacheMemory();
+    CHECK(nMemory != 0);
+
+    lpRecords = QueryAllByContent(L"apple", &nMatchCount);
+    CHECK(nMatchCount == 2);
+    CHECK(lpRecords[0].nIndex == 0 && lpRecords[1].nIndex == 2);
+    CheckRecords(lpRecords, nMatchCount, L"apple", false);
+    CHECK(GetQueryCacheMemory() == nMemory);
+
+    lpRecords = FuzzyQueryAllByContent(L"apple", &nMatchCount);
+    CHECK(nMatchCount == 3);
+    CheckRecords(lpRecords, nMatchCount, L"apple", true);
+    CHECK(GetQueryCacheMemory() > nMemory);
+
+    // Queries do not change database
+    CHECK(GetDatabaseVersion() == nVersion);
+
+    // Memory of results is bounded
+    wchar_t szKey[16];
+    for (size_t i = 0; i != 100; ++i)
+    {
+        swprintf(szKey, 16, L"key-%zu", i);
+        FuzzyQueryAllByContent(szKey, &nMatchCount);
+        CHECK(nMatchCount == 0);
+    }
+
+    CHECK(GetQueryCacheMemory() <= CACHE_MEMORY);
+}
+
+/*
+    Every change makes cached results outdated
+*/
+void TestQueryCacheInvalidate()
+{
+    CHECK(Store(L"red", NULL) == true);
+    CHECK(Store(L"green", NULL) == true);
+
+    size_t nMatchCount = 0;
+    const QueryRecord *lpRecords = QueryAllByContent(L"red", &nMatchCount);
+    CHECK(nMatchCount == 1);
+
+    size_t nVersion = GetDatabaseVersion();
+    CHECK(Store(L"red", NULL) == true);
+    CHECK(GetDatabaseVersion() != nVersion);
+    lpRecords = QueryAllByContent(L"red", &nMatchCount);
+    CHECK(nMatchCount == 2);
+    CheckRecords(lpRecords, nMatchCount, L"red", false);
+
+    CHECK(DeleteByIndex(0) == true);
+    lpRecords = QueryAllByContent(L"red", &nMatchCount);
+    CHECK(nMatchCount == 1 && lpRecords[0].nIndex == 1);
+    CheckRecords(lpRecords, nMatchCount, L"red", false);
+
+    lpRecords = FuzzyQueryAllByContent(L"re", &nMatchCount);
+    CHECK(nMatchCount == 2);
+    CHECK(AlterByIndex(0, L"blue", NULL) == true);
+    lpRecords = FuzzyQueryAllByContent(L"re", &nMatchCount);
+    CHECK(nMatchCount == 1);
+    CheckRecords(lpRecords, nMatchCount, L"re", true);
+
+    CHECK(AppendToItem(0, L"-red", NULL) == true);
+    lpRecords = FuzzyQueryAllByContent(L"re", &nMatchCount);
+    CHECK(nMatchCount == 2);
+    CheckRecords(lpRecords, nMatchCount, L"re", true);
+
+    ClearDatabase();
+    lpRecords = FuzzyQueryAllByContent(L"re", &nMatchCount);
+    CHECK(nMatchCount == 0);
+}
+
+/*
+    Defragment changes version only when it moves strings, and cached
+    records point to the moved strings
+*/
+void TestQueryCacheDefrag()
+{
+    wchar_t szString[16];
+    for (size_t i = 0; i != 10; ++i)
+    {
+        swprintf(szString, 16, L"value-%zu", i % 2);
+        CHECK(Store(szString, NULL) == true);
+    }
+
+    size_t nVersion = GetDatabaseVersion();
+    DefragDatabase();
+    CHECK(GetDatabaseVersion() == nVersion);
+
+    size_t nMatchCount = 0;
+    const QueryRecord *lpRecords = QueryAllByContent(L"value-1", &nMatchCount);
+    CHECK(nMatchCount == 5);
+    size_t nMemory = GetQueryCacheMemory();
+
+    CHECK(DeleteByIndex(0) == true);
+    nVersion = GetDatabaseVersion();
+    DefragDatabase();
+    CHECK(GetDatabaseVersion() != nVersion);
+
+    lpRecords = QueryAllByContent(L"value-1", &nMatchCount);
+    CHECK(nMatchCount == 5);
+    CHECK(lpRecords[0].nIndex == 0);
+    CheckRecords(lpRecords, nMatchCount, L"value-1", false);
+    CHECK(GetQueryCacheMemory() == nMemory);
+}
@@ -0,0 +1,111 @@
+/******************************************************
+ - FileName
+    TestQueryMode.c
+ - Description
+    Tests of case insensitive and normalized query
+    modes, which compare folded keys of strings
+*******************************************************/
+#include <wchar.h>
+#include "StrDb.h"
+#include "StrDbCodec.h"
+#include "StrDbShard.h"
+#include "StrDbTest.h"
+
+/*
+    Check a string is folded to the expected string
+*/
+static void CheckFold(const wchar_t *lpString, bool bNormalize, const wchar_t *lpExpected)
+{
+    wchar_t szFolded[64];
+    size_t nLength = FoldString(lpString, wcslen(lpString), bNormalize, szFolded);
+    CHECK(nLength == wcslen(lpExpected));
+    CHECK(wmemcmp(szFolded, lpExpected, wcslen(lpExpected)) == 0);
+    CHECK(HashFoldedString(lpString, wcslen(lpString), bNormalize)
+        == HashFoldedString(lpExpected, wcslen(lpExpected), bNormalize));
+}
+
+/*
+    Case folding keeps diacritics and spaces, normalizing strips them
+*/
+void TestFoldString()
+{
+    CheckFold(L"HeLLo World", false, L"hello world");
+    CheckFold(L"CAF\x00C9  Noir", false, L"caf\x00E9  noir");
+    CheckFold(L"123-_!", false, L"123-_!");
+
+    CheckFold(L"CAF\x00C9  Noir", true, L"cafe noir");
+    CheckFold(L"  \t\x00C0 la  carte \r\n", true, L"a la carte");
+    CheckFold(L"\xFF21\xFF22\xFF43\xFF11", true, L"abc1");
+    CheckFold(L"   ", true, L"");
+
+    CHECK(HashFoldedString(L"abc", 3, false) != HashFoldedString(L"abd", 3, false));
+}
+
+/*
+    Queries in each mode find strings with the same folded key, and keys
+    follow strings when they are altered
+*/
+void TestQueryModes()
+{
+    CHECK(Store(L"Hello World", NULL) == true);
+    CHECK(Store(L"HELLO world", NULL) == true);
+    CHECK(Store(L"h\x00E9llo  World ", NULL) == true);
+    CHECK(Store(L"other", NULL) == true);
+
+    size_t nMatchCount = 0;
+    QueryAllByContentEx(L"hello world", QUERY_MODE_EXACT, &nMatchCount);
+    CHECK(nMatchCount == 0);
+    QueryAllByContentEx(L"hello world", QUERY_MODE_IGNORE_CASE, &nMatchCount);
+    CHECK(nMatchCount == 2);
+    const QueryRecord *lpRecords =
+        QueryAllByContentEx(L"HELLO WORLD", QUERY_MODE_NORMALIZED, &nMatchCount);
+    CHECK(nMatchCount == 3);
+    CHECK(nMatchCount == 3 && lpRecords[2].nIndex == 2);
+    CHECK(nMatchCount == 3 && wcscmp(lpRecords[2].lpData, L"h\x00E9llo  World ") == 0);
+
+    size_t nMatchIndex = 0;
+    CHECK(QueryNextByContentEx(L"hello WORLD", QUERY_MODE_IGNORE_CASE, 1, &nMatchIndex) != NULL);
+    CHECK(nMatchIndex == 1);
+    CHECK(QueryNextByContentEx(L"hello WORLD", QUERY_MODE_IGNORE_CASE, 2, NULL) == NULL);
+
+    FuzzyQueryAllByContentEx(L"LLO W", QUERY_MODE_EXACT, &nMatchCount);
+    CHECK(nMatchCount == 0);
+    FuzzyQueryAllByContentEx(L"LLO W", QUERY_MODE_IGNORE_CASE, &nMatchCount);
+    CHECK(nMatchCount == 2);
+    FuzzyQueryAllByContentEx(L"ELLO W", QUERY_MODE_NORMALIZED, &nMatchCount);
+    CHECK(nMatchCount == 3);
+
+    // Keys of altered and spliced strings are computed again
+    CHECK(AlterByIndex(3, L"hello WORLD", NULL) == true);
+    QueryAllByContentEx(L"hello world", QUERY_MODE_IGNORE_CASE, &nMatchCount);
+    CHECK(nMatchCount == 3);
+    CHECK(AppendToItem(0, L"!", NULL) == true);
+    QueryAllByContentEx(L"hello world", QUERY_MODE_IGNORE_CASE, &nMatchCount);
+    CHECK(nMatchCount == 2);
+    QueryAllByContentEx(L"hello world!", QUERY_MODE_NORMALIZED, &nMatchCount);
+    CHECK(nMatchCount == 1);
+    CHECK(DeleteByIndex(1) == true);
+    QueryAllByContentEx(L"hello world", QUERY_MODE_NORMALIZED, &nMatchCount);
+    CHECK(nMatchCount == 2);
+}
+
+/*
+    Strings are routed to shards by normalized content, so one shard
+    holds all strings a query in any mode matches
+*/
+void TestShardQueryModes()
+{
+    CHECK(InitShards() == true);
+
+    CHECK(ShardStore(L"Blue Sky", NULL) == true);
+    CHECK(ShardStore(L"BLUE SKY", NULL) == true);
+    CHECK(ShardStore(L"bl\x00FC\x0065  sky", NULL) == true);
+
+    ShardHandle Handles[8];
+    CHECK(ShardQueryAllByContentEx(L"blue sky", QUERY_MODE_EXACT, Handles, 8) == 0);
+    CHECK(ShardQueryAllByContentEx(L"blue sky", QUERY_MODE_IGNORE_CASE, Handles, 8) == 2);
+    CHECK(ShardQueryAllByContentEx(L"blue sky", QUERY_MODE_NORMALIZED, Handles, 8) == 3);
+    CHECK(ShardFuzzyQueryAllByContentEx(L"UE S", QUERY_MODE_IGNORE_CASE, Handles, 8) == 2);
+
+    ReleaseShards();
+}
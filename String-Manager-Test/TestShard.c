@@ -0,0 +1,172 @@
+/******************************************************
+ - FileName
+    TestShard.c
+ - Description
+    Tests of sharded front end, whose handles encode
+    shards and ids of strings
+*******************************************************/
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include "StrDbShard.h"
+#include "StrDbTest.h"
+
+// Low bits of handle are its shard
+#define SHARD_MASK      ((ShardHandle)SHARD_COUNT - 1)
+
+/*
+    Handles route to shards by content, and stay valid until their
+    strings are deleted, however other strings change
+*/
+void TestShardHandle()
+{
+    CHECK(InitShards() == true);
+
+    ShardHandle Handles[32];
+    wchar_t szString[16], szBuffer[16];
+    for (size_t i = 0; i != 32; ++i)
+    {
+        swprintf(szString, 16, L"key-%zu", i);
+        CHECK(ShardStore(szString, &Handles[i]) == true);
+    }
+
+    // The same content is in the same shard
+    ShardHandle hCopy = 0;
+    CHECK(ShardStore(L"key-7", &hCopy) == true);
+    CHECK((hCopy & SHARD_MASK) == (Handles[7] & SHARD_MASK));
+    CHECK(hCopy != Handles[7]);
+
+    // Strings are spread over shards
+    size_t nShardMask = 0;
+    for (size_t i = 0; i != 32; ++i)
+    {
+        nShardMask |= (size_t)1 << (Handles[i] & SHARD_MASK);
+    }
+
+    CHECK((nShardMask & (nShardMask - 1)) != 0);
+
+    // Deleting strings does not shift handles of others
+    for (size_t i = 0; i != 32; i += 2)
+    {
+        CHECK(ShardDeleteByHandle(Handles[i]) == true);
+    }
+
+    for (size_t i = 0; i != 32; ++i)
+    {
+        swprintf(szString, 16, L"key-%zu", i);
+        size_t nLength = ShardQueryByHandle(Handles[i], szBuffer, 16);
+        if (i % 2 == 0)
+        {
+            CHECK(nLength == 0);
+        }
+        else
+        {
+            CHECK(nLength == wcslen(szString) + 1);
+            CHECK(wcscmp(szBuffer, szString) == 0);
+        }
+    }
+
+    // Slots reused by new strings do not revive old handles
+    for (size_t i = 0; i != 32; i += 2)
+    {
+        swprintf(szString, 16, L"key-%zu", i);
+        ShardHandle hItem = 0;
+        CHECK(ShardStore(szString, &hItem) == true);
+        CHECK(hItem != Handles[i]);
+        CHECK(ShardQueryByHandle(Handles[i], NULL, 0) == 0);
+        CHECK(ShardDeleteByHandle(Handles[i]) == false);
+    }
+
+    // Short buffer gets the length only
+    szBuffer[0] = L'\0';
+    CHECK(ShardQueryByHandle(Handles[11], szBuffer, 3) == 7);
+    CHECK(szBuffer[0] == L'\0');
+
+    // Altered string is moved to the shard of new content
+    ShardHandle hNew = 0;
+    CHECK(ShardAlterByHandle(Handles[1], L"key-7", &hNew) == true);
+    CHECK((hNew & SHARD_MASK) == (Handles[7] & SHARD_MASK));
+    CHECK(ShardQueryByHandle(hNew, szBuffer, 16) == 6 && wcscmp(szBuffer, L"key-7") == 0);
+    CHECK(ShardQueryAllByContent(L"key-7", NULL, 0) == 3);
+
+    ReleaseShards();
+}
+
+/*
+    Fuzzy queries and statistic gather results of all shards
+*/
+void TestShardScatter()
+{
+    CHECK(InitShards() == true);
+
+    wchar_t szString[16];
+    size_t nTotal = 0;
+    for (size_t i = 0; i != 40; ++i)
+    {
+        swprintf(szString, 16, L"item%zu", i);
+        CHECK(ShardStore(szString, NULL) == true);
+        nTotal += wcslen(szString);
+    }
+
+    ShardHandle Handles[64];
+    size_t nMatchCount = ShardFuzzyQueryAllByContent(L"item1", Handles, 64);
+    CHECK(nMatchCount == 11);
+    for (size_t i = 0; i != nMatchCount && i != 64; ++i)
+    {
+        wchar_t szBuffer[16];
+        CHECK(ShardQueryByHandle(Handles[i], szBuffer, 16) != 0);
+        CHECK(wcsncmp(szBuffer, L"item1", 5) == 0);
+    }
+
+    // Count is kept when handles do not fit
+    CHECK(ShardFuzzyQueryAllByContent(L"item", Handles, 4) == 40);
+
+    size_t Counts[62] = { 0 }, nCountTotal = 0;
+    CHECK(ShardStatistic(Counts, 62, &nCountTotal) == true);
+    CHECK(nCountTotal == nTotal);
+    CHECK(Counts[L'i' - L'a' + 36] == 40);
+    CHECK(Counts[L'0' - L'0'] == 4);
+
+    ReleaseShards();
+}
+
+/*
+    Strings altered to another shard are altered all or none
+*/
+void TestShardAlterAll()
+{
+    CHECK(InitShards() == true);
+
+    // A string which fits small storage, but only a few times
+    wchar_t szLong[101];
+    wmemset(szLong, L'z', 100);
+    szLong[100] = L'\0';
+
+    ShardHandle hShort = 0, hLong = 0;
+    CHECK(ShardStore(L"b", &hShort) == true);
+    CHECK(ShardStore(szLong, &hLong) == true);
+    CHECK((hShort & SHARD_MASK) != (hLong & SHARD_MASK));
+    CHECK(ShardDeleteAllByContent(szLong) == 1);
+
+    for (size_t i = 0; i != 19; ++i)
+    {
+        CHECK(ShardStore(L"b", NULL) == true);
+    }
+
+    CHECK(ShardAlterAllByContent(L"b", szLong) == SIZE_MAX);
+    CHECK(ShardQueryAllByContent(L"b", NULL, 0) == 20);
+    CHECK(ShardQueryAllByContent(szLong, NULL, 0) == 0);
+    CHECK(ShardQueryByHandle(hShort, NULL, 0) == 2);
+
+    CHECK(ShardDeleteAllByContent(L"b") == 20);
+    for (size_t i = 0; i != 3; ++i)
+    {
+        CHECK(ShardStore(L"b", NULL) == true);
+    }
+
+    CHECK(ShardAlterAllByContent(L"b", szLong) == 3);
+    CHECK(ShardQueryAllByContent(L"b", NULL, 0) == 0);
+    CHECK(ShardQueryAllByContent(szLong, NULL, 0) == 3);
+
+    ReleaseShards();
+}
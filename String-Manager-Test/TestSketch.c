@@ -0,0 +1,156 @@
+/******************************************************
+ - FileName
+    TestSketch.c
+ - Description
+    Tests of heavy hitter and cardinality sketches,
+    whose estimates are within their error bounds
+*******************************************************/
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+#include <wchar.h>
+#include "StrDb.h"
+#include "StrDbSketch.h"
+#include "StrDbTest.h"
+
+// Keys and strings added to sketches directly
+#define KEY_COUNT       5000
+#define STRING_COUNT    100000
+
+/*
+    Estimates of database follow strings stored, deleted and altered
+*/
+void TestSketchDatabase()
+{
+    wchar_t szString[16];
+    for (size_t i = 0; i != 50; ++i)
+    {
+        CHECK(Store(L"a", NULL) == true);
+    }
+
+    for (size_t i = 0; i != 20; ++i)
+    {
+        CHECK(Store(L"b", NULL) == true);
+    }
+
+    for (size_t i = 0; i != 100; ++i)
+    {
+        swprintf(szString, 16, L"k%zu", i);
+        CHECK(Store(szString, NULL) == true);
+    }
+
+    // Error is at most 1/SKETCH_EPSILON_INVERSE of all strings counted
+    CHECK(EstimateStringCount(L"a") >= 50 && EstimateStringCount(L"a") <= 51);
+    CHECK(EstimateStringCount(L"b") >= 20 && EstimateStringCount(L"b") <= 21);
+    CHECK(EstimateStringCount(L"k7") >= 1 && EstimateStringCount(L"k7") <= 2);
+    CHECK(EstimateStringCount(L"missing") <= 1);
+
+    FrequentItem Items[TOP_K_COUNT];
+    size_t nCount = GetFrequentStrings(Items, TOP_K_COUNT);
+    CHECK(nCount >= 2);
+    CHECK(nCount >= 2 && wcscmp(Items[0].szData, L"a") == 0 && Items[0].nCount >= 50);
+    CHECK(nCount >= 2 && wcscmp(Items[1].szData, L"b") == 0 && Items[1].nCount >= 20);
+    for (size_t i = 1; i < nCount; ++i)
+    {
+        CHECK(Items[i - 1].nCount >= Items[i].nCount);
+    }
+
+    CHECK(GetFrequentStrings(Items, 1) == 1);
+
+    // Deleted and altered strings are not counted any more
+    CHECK(DeleteAllByContent(L"a") == 50);
+    CHECK(EstimateStringCount(L"a") <= 1);
+    CHECK(AlterAllByContent(L"b", L"c") == 20);
+    CHECK(EstimateStringCount(L"b") <= 1);
+    CHECK(EstimateStringCount(L"c") >= 20);
+    nCount = GetFrequentStrings(Items, TOP_K_COUNT);
+    CHECK(nCount >= 1 && wcscmp(Items[0].szData, L"c") == 0);
+
+    // Distinct strings are counted even after they are deleted
+    size_t nDistinct = EstimateDistinctCount();
+    CHECK(nDistinct >= 98 && nDistinct <= 108);
+}
+
+/*
+    Bigrams and trigrams of strings are counted
+*/
+void TestSketchNGrams()
+{
+    for (size_t i = 0; i != 10; ++i)
+    {
+        CHECK(Store(L"abcab", NULL) == true);
+    }
+
+    CHECK(Store(L"xyz", NULL) == true);
+
+    FrequentItem Items[TOP_K_COUNT];
+    size_t nCount = GetFrequentNGrams(2, Items, TOP_K_COUNT);
+    CHECK(nCount >= 3);
+    CHECK(nCount >= 1 && wcscmp(Items[0].szData, L"ab") == 0 && Items[0].nCount >= 20);
+    CHECK(nCount >= 1 && Items[0].nLength == 2);
+
+    nCount = GetFrequentNGrams(3, Items, TOP_K_COUNT);
+    CHECK(nCount >= 3);
+    CHECK(nCount >= 1 && Items[0].nCount >= 10 && Items[0].nLength == 3);
+
+    CHECK(GetFrequentNGrams(1, Items, TOP_K_COUNT) == 0);
+    CHECK(GetFrequentNGrams(4, Items, TOP_K_COUNT) == 0);
+}
+
+/*
+    On a long skewed stream, estimates are never less than real counts,
+    few exceed the error bound, and the heaviest keys are found
+*/
+void TestSketchBounds()
+{
+    static SketchSet Sketches;
+    static size_t Counts[KEY_COUNT];
+    memset(&Sketches, 0, sizeof(Sketches));
+    memset(Counts, 0, sizeof(Counts));
+
+    // Keys are log-uniform, so small keys are heavy, key-0 takes about
+    // 8% of strings and key-1 about 5%
+    uint32_t nSeed = 1;
+    wchar_t szKey[16];
+    for (size_t i = 0; i != STRING_COUNT; ++i)
+    {
+        nSeed = nSeed * 1103515245u + 12345u;
+        double dRandom = (double)(nSeed >> 8) / (1 << 24);
+        size_t nKey = (size_t)pow(KEY_COUNT, dRandom) - 1;
+        swprintf(szKey, 16, L"key-%zu", nKey);
+        AddToSketches(&Sketches, szKey, wcslen(szKey));
+        ++Counts[nKey];
+    }
+
+    size_t nUnderCount = 0, nOverBound = 0, nDistinct = 0;
+    for (size_t i = 0; i != KEY_COUNT; ++i)
+    {
+        swprintf(szKey, 16, L"key-%zu", i);
+        size_t nEstimate = EstimateCount(&Sketches, szKey, wcslen(szKey));
+        nUnderCount += (nEstimate < Counts[i]) ? 1 : 0;
+        nOverBound += (nEstimate > Counts[i] + STRING_COUNT / SKETCH_EPSILON_INVERSE) ? 1 : 0;
+        nDistinct += (Counts[i] != 0) ? 1 : 0;
+    }
+
+    CHECK(nUnderCount == 0);
+    CHECK(nOverBound <= KEY_COUNT / 100);
+
+    // The most frequent keys are the first candidates
+    FrequentItem Items[TOP_K_COUNT];
+    size_t nCount = GetHeavyHitters(&Sketches.FrequentStrings, Items, TOP_K_COUNT);
+    CHECK(nCount == TOP_K_COUNT);
+    CHECK(wcscmp(Items[0].szData, L"key-0") == 0);
+    CHECK(Items[0].nCount >= Counts[0]);
+
+    // HyperLogLog of 4096 registers has about 1.6% standard error
+    size_t nEstimate = EstimateCardinality(&Sketches.Distinct);
+    CHECK(nEstimate * 100 >= nDistinct * 95 && nEstimate * 100 <= nDistinct * 105);
+
+    // Removed keys are counted down
+    for (size_t i = 0; i != Counts[1]; ++i)
+    {
+        RemoveFromSketches(&Sketches, L"key-1", 5);
+    }
+
+    CHECK(EstimateCount(&Sketches, L"key-1", 5) <= STRING_COUNT / SKETCH_EPSILON_INVERSE);
+}
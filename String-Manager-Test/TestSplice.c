@@ -0,0 +1,96 @@
+/******************************************************
+ - FileName
+    TestSplice.c
+ - Description
+    Tests of splicing strings, which grow on the
+    same place when the gap behind is large enough
+*******************************************************/
+#include <stdint.h>
+#include <wchar.h>
+#include "StrDb.h"
+#include "StrDbTest.h"
+
+/*
+    Ranges out of string are rejected, and the string is kept
+*/
+void TestSpliceBounds()
+{
+    CHECK(Store(L"hello", NULL) == true);
+
+    CHECK(SpliceItem(1, 0, 0, L"x", NULL) == false);
+    CHECK(SpliceItem(0, 6, 0, L"x", NULL) == false);
+    CHECK(SpliceItem(0, 3, 3, L"x", NULL) == false);
+    CHECK(SpliceItem(0, 0, (size_t)-1, L"x", NULL) == false);
+    CHECK(EraseRange(0, 5, 1, NULL) == false);
+    CHECK(InsertAtOffset(0, 6, L"x", NULL) == false);
+    CHECK(wcscmp(GetItem(0, NULL), L"hello") == 0);
+
+    // Offset at the end and erasing to the end are in range
+    CHECK(InsertAtOffset(0, 5, L"!", NULL) == true);
+    CHECK(wcscmp(GetItem(0, NULL), L"hello!") == 0);
+    CHECK(EraseRange(0, 4, 2, NULL) == true);
+    CHECK(wcscmp(GetItem(0, NULL), L"hell") == 0);
+    CHECK(SpliceItem(0, 0, 4, L"", NULL) == true);
+    CHECK(wcscmp(GetItem(0, NULL), L"") == 0);
+}
+
+/*
+    Strings grow into the gap behind them, and keep their indexes and ids
+*/
+void TestSpliceInPlace()
+{
+    CHECK(Store(L"abc", NULL) == true);
+    CHECK(Store(L"0123456789", NULL) == true);
+    CHECK(Store(L"tail", NULL) == true);
+    CHECK(DeleteByIndex(1) == true);
+
+    const wchar_t *lpString = GetItem(0, NULL);
+    size_t nId = GetItemId(0);
+    size_t nNewIndex = SIZE_MAX;
+    CHECK(AppendToItem(0, L"def", &nNewIndex) == true);
+    CHECK(nNewIndex == 0);
+    CHECK(GetItem(0, NULL) == lpString);
+    CHECK(GetItemId(0) == nId);
+    CHECK(wcscmp(GetItem(0, NULL), L"abcdef") == 0);
+
+    CHECK(InsertAtOffset(0, 3, L"-", &nNewIndex) == true && nNewIndex == 0);
+    CHECK(wcscmp(GetItem(0, NULL), L"abc-def") == 0);
+    CHECK(SpliceItem(0, 1, 5, L"BCDE", &nNewIndex) == true && nNewIndex == 0);
+    CHECK(wcscmp(GetItem(0, NULL), L"aBCDEf") == 0);
+    CHECK(EraseRange(0, 0, 2, &nNewIndex) == true && nNewIndex == 0);
+    CHECK(wcscmp(GetItem(0, NULL), L"CDEf") == 0);
+    CHECK(GetItem(0, NULL) == lpString);
+    CHECK(GetItemId(0) == nId);
+
+    // The string behind is not touched
+    CHECK(wcscmp(GetItem(1, NULL), L"tail") == 0);
+    CHECK(GetUsedSize() == 5 + 5);
+}
+
+/*
+    Strings without gap behind are moved, and strings in storage can be
+    inserted into themselves
+*/
+void TestSpliceMoved()
+{
+    CHECK(Store(L"abc", NULL) == true);
+    CHECK(Store(L"xyz", NULL) == true);
+
+    size_t nId = GetItemId(0);
+    size_t nNewIndex = SIZE_MAX;
+    CHECK(AppendToItem(0, L"def", &nNewIndex) == true);
+    CHECK(nNewIndex != SIZE_MAX);
+    CHECK(wcscmp(GetItem(nNewIndex, NULL), L"abcdef") == 0);
+    CHECK(GetItemId(nNewIndex) != nId);
+    CHECK(GetIndexById(nId) == SIZE_MAX);
+    CHECK(GetItemCount() == 2);
+    CHECK(GetUsedSize() == 7 + 4);
+
+    size_t nOther = (nNewIndex == 0) ? 1 : 0;
+    CHECK(wcscmp(GetItem(nOther, NULL), L"xyz") == 0);
+
+    CHECK(InsertAtOffset(nOther, 3, GetItem(nOther, NULL), &nNewIndex) == true);
+    CHECK(wcscmp(GetItem(nNewIndex, NULL), L"xyzxyz") == 0);
+    CHECK(SpliceItem(nNewIndex, 1, 1, GetItem(nNewIndex, NULL), &nNewIndex) == true);
+    CHECK(wcscmp(GetItem(nNewIndex, NULL), L"xxyzxyzzxyz") == 0);
+}
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "StrDb.h"
+#include "StrDbTest.h"
+
+/*
+    A test and its name
+*/
+typedef struct _TestCase
+{
+    const char *lpName;
+    void (*lpTest)();
+} TestCase;
+
+static const TestCase g_Tests[] =
+{
+    { "IndexLayout", TestIndexLayout },
+    { "IndexDefrag", TestIndexDefrag },
+    { "SpliceBounds", TestSpliceBounds },
+    { "SpliceInPlace", TestSpliceInPlace },
+    { "SpliceMoved", TestSpliceMoved },
+    { "LargeStorageTier", TestLargeStorageTier },
+    { "LargeStorageDefrag", TestLargeStorageDefrag },
+    { "LargeStorageFull", TestLargeStorageFull },
+    { "CodecRoundTrip", TestCodecRoundTrip },
+    { "CodeMatcher", TestCodeMatcher },
+    { "CompressItems", TestCompressItems },
+    { "DecodeUtf8", TestDecodeUtf8 },
+    { "LoadLines", TestLoadLines },
+    { "LoadFull", TestLoadFull },
+    { "LoadFileName", TestLoadFileName },
+    { "QueryCacheHit", TestQueryCacheHit },
+    { "QueryCacheInvalidate", TestQueryCacheInvalidate },
+    { "QueryCacheDefrag", TestQueryCacheDefrag },
+    { "ShardHandle", TestShardHandle },
+    { "ShardScatter", TestShardScatter },
+    { "ShardAlterAll", TestShardAlterAll },
+    { "ProtocolIntegers", TestProtocolIntegers },
+    { "FrameParse", TestFrameParse },
+    { "FoldString", TestFoldString },
+    { "QueryModes", TestQueryModes },
+    { "ShardQueryModes", TestShardQueryModes },
+    { "SketchDatabase", TestSketchDatabase },
+    { "SketchNGrams", TestSketchNGrams },
+    { "SketchBounds", TestSketchBounds },
+    { "ChangeEvents", TestChangeEvents },
+    { "ChangeCursorLost", TestChangeCursorLost },
+    { "ChangeMirror", TestChangeMirror },
+    { "ShardChangeFeed", TestShardChangeFeed },
+};
+
+static size_t g_nCheckCount = 0;
+static size_t g_nFailedCount = 0;
+
+/*
+    Count a check, and print it if it is failed
+*/
+void CheckCondition(bool bPassed, const char *lpCondition, const char *lpFileName, int nLine)
+{
+    ++g_nCheckCount;
+    if (bPassed == false)
+    {
+        ++g_nFailedCount;
+        printf("    %s(%d): CHECK(%s) failed\n", lpFileName, nLine, lpCondition);
+    }
+}
+
+int main()
+{
+    size_t nFailedTests = 0;
+    for (size_t i = 0; i != sizeof(g_Tests) / sizeof(g_Tests[0]); ++i)
+    {
+        Database *lpDatabase = CreateDatabase();
+        if (lpDatabase == NULL)
+        {
+            printf("Database can not be created\n");
+            return EXIT_FAILURE;
+        }
+
+        // Each test starts with an empty database
+        size_t nFailedBefore = g_nFailedCount;
+        SelectDatabase(lpDatabase);
+        g_Tests[i].lpTest();
+        DestroyDatabase(lpDatabase);
+
+        bool bPassed = (g_nFailedCount == nFailedBefore);
+        printf("%-24s %s\n", g_Tests[i].lpName, (bPassed == true) ? "passed" : "FAILED");
+        if (bPassed == false)
+        {
+            ++nFailedTests;
+        }
+    }
+
+    printf("%zu tests, %zu failed, %zu checks, %zu failed\n",
+        sizeof(g_Tests) / sizeof(g_Tests[0]), nFailedTests, g_nCheckCount, g_nFailedCount);
+    return (nFailedTests == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
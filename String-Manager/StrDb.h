@@ -17,6 +17,117 @@ typedef struct _QueryRecord
     size_t nIndex;          // String Index in database
 } QueryRecord;
 
+/*
+    Frequent string or n-gram estimated by sketches
+*/
+#define FREQUENT_ITEM_LENGTH    32  // Max characters kept, including '\0'
+
+typedef struct _FrequentItem
+{
+    wchar_t szData[FREQUENT_ITEM_LENGTH];   // String or n-gram, cut if it is too long
+    size_t nLength;                         // Number of characters, not including '\0'
+    size_t nCount;                          // Estimated count, never less than real count
+} FrequentItem;
+
+/*
+    Change event types
+*/
+#define CHANGE_STORE        1   // String is stored at index, strings from index are shifted back
+#define CHANGE_DELETE       2   // String at index is deleted, strings behind are shifted forward
+#define CHANGE_ALTER        3   // String at previous index is altered, and it is at index after
+                                // change. If indexes differ, it is moved with a new id, and strings
+                                // are shifted as if it is deleted and stored again
+#define CHANGE_RELOCATE     4   // Strings from index are moved by defragment
+#define CHANGE_CLEAR        5   // All strings are deleted
+
+// Returned when events from cursor are overwritten
+#define CHANGE_CURSOR_LOST  ((size_t)-1)
+
+/*
+    Mutation of database, to mirror database incrementally
+*/
+typedef struct _ChangeEvent
+{
+    size_t nSequence;   // Sequence number, from 1 and increased by 1 for each event
+    int nType;          // Change type, CHANGE_*
+    size_t nIndex;      // String index in database after change
+    size_t nId;         // String id after change, SIZE_MAX if relocated or cleared
+    size_t nPreviousIndex;  // String index before change, equal to nIndex
+                            // unless an altered string is moved
+    size_t nPreviousId;     // String id before change, equal to nId unless
+                            // an altered string is moved
+    size_t nOffset;     // String offset in storage after change
+    size_t nLength;     // Number of characters in string, including '\0',
+                        // or number of strings moved if relocated
+    size_t nDataPosition;   // Position of string stored or altered in payload
+                            // arena, read by ReadChangeData
+} ChangeEvent;
+
+/*
+    Copy of all strings with their ids at a change sequence, to start
+    mirroring database from it
+*/
+typedef struct _Snapshot
+{
+    size_t nSequence;           // Sequence of the latest change copied
+    size_t nCount;              // Number of strings
+    size_t *lpIds;              // String ids, in index order
+    const wchar_t **lpStrings;  // Strings with '\0', in index order
+} Snapshot;
+
+/*
+    Query modes, how strings are compared with the string queried
+*/
+#define QUERY_MODE_EXACT        0   // Exactly equal
+#define QUERY_MODE_IGNORE_CASE  1   // Equal after case folding
+#define QUERY_MODE_NORMALIZED   2   // Equal after case folding, stripping 
+                                    // diacritics and collapsing white spaces
+
+/*
+    String database, all functions work on the database selected by
+    current thread, or the default database if none is selected
+*/
+typedef struct _Database Database;
+
+/*
+    Record file loading result
+*/
+typedef struct _LoadResult
+{
+    size_t nLoadCount;          // Number of strings loaded
+    size_t nDropCount;          // Number of strings not loaded for no space
+    size_t nByteCount;          // File size in bytes
+    double dSeconds;            // Time elapsed
+    double dMegabytesPerSecond; // Loading throughput
+} LoadResult;
+
+/*
+ - Description
+    Create an empty database
+ - Return
+    The new database, or NULL if out of memory
+*/
+Database *CreateDatabase();
+
+/*
+ - Description
+    Destroy a database created by CreateDatabase. If it is selected by
+    current thread, the default database is selected
+ - Input
+    lpDatabase: The database to destroy
+*/
+void DestroyDatabase(Database *lpDatabase);
+
+/*
+ - Description
+    Select the database for current thread to work on
+ - Input
+    lpDatabase: The database to select, or NULL to select the default one
+ - Return
+    The database selected before
+*/
+Database *SelectDatabase(Database *lpDatabase);
+
 /*
     Clear database
 */
@@ -45,6 +156,41 @@ size_t GetUsedSize();
 */
 size_t GetFreeSize();
 
+/*
+    Get the total size of large storage
+*/
+size_t GetLargeTotalSize();
+
+/*
+    Get the used size of large storage, in whole extents
+*/
+size_t GetLargeUsedSize();
+
+/*
+    Get the free size of large storage, in whole extents
+*/
+size_t GetLargeFreeSize();
+
+/*
+ - Description
+    Set the threshold of large strings. Strings longer than it are stored 
+    in extents of large storage, which are never moved by defragment
+ - Input
+    nThreshold: Number of characters, including '\0'
+*/
+void SetLargeStringThreshold(size_t nThreshold);
+
+/*
+    Get database version, it is changed by every modification,
+    and cached query results of older versions are invalid
+*/
+size_t GetDatabaseVersion();
+
+/*
+    Get memory in bytes used by cached query results
+*/
+size_t GetQueryCacheMemory();
+
 /*
     Get string count in database
 */
@@ -67,6 +213,28 @@ const wchar_t GetStorage();
 */
 const wchar_t *GetItem(size_t nIndex, size_t *lpLength);
 
+/*
+ - Description
+    Get the id of string. Unlike index, id is not shifted by storing or
+    deleting other strings, and is kept while the string is altered on
+    the same place. Ids of deleted strings are never valid again
+ - Input
+    nIndex: The index of string
+ - Return
+    The id of string, or SIZE_MAX if index is out of range
+*/
+size_t GetItemId(size_t nIndex);
+
+/*
+ - Description
+    Get the current index of string by id
+ - Input
+    nId: The id of string
+ - Return
+    The index of string, or SIZE_MAX if the string is deleted
+*/
+size_t GetIndexById(size_t nId);
+
 /*
  - Description
     Store string to database
@@ -79,6 +247,21 @@ const wchar_t *GetItem(size_t nIndex, size_t *lpLength);
 */
 bool Store(const wchar_t *lpString, size_t *lpIndex);
 
+/*
+ - Description
+    Load strings from a UTF-8 text file, separated by '\n' or '\0'. 
+    The file is mapped to memory, and strings are decoded and packed
+    into storage one next to one without looking up free space.
+    Empty lines are skipped
+ - Input
+    lpFileName: The file name
+ - Output
+    lpResult: The loading result
+ - Return
+    true if successful, or false if file can not be read
+*/
+bool LoadFromFile(const wchar_t *lpFileName, LoadResult *lpResult);
+
 /*
  - Description
     Query string by index
@@ -105,6 +288,23 @@ const wchar_t *QueryByIndex(size_t nIndex, size_t *lpLength);
 const wchar_t *QueryNextByContent(
     const wchar_t *lpString, size_t nBeginIndex, size_t *lpMatchIndex);
 
+/*
+ - Description
+    Query next matched string by content in a query mode. Folded keys of
+    strings are computed when stored, so only strings with the same key
+    are folded and compared
+ - Input
+    lpString: The string to query
+    nMode: The query mode, QUERY_MODE_*
+    nBeginIndex: The index of beginning to search
+ - Output
+    lpMatchIndex: The matched string index. It can be NULL
+ - Return
+    The next matched string pointer, or NULL
+*/
+const wchar_t *QueryNextByContentEx(const wchar_t *lpString,
+    int nMode, size_t nBeginIndex, size_t *lpMatchIndex);
+
 /*
  - Description
     Query all strings by content
@@ -117,6 +317,20 @@ const wchar_t *QueryNextByContent(
 */
 const QueryRecord *QueryAllByContent(const wchar_t *lpString, size_t *lpMatchCount);
 
+/*
+ - Description
+    Query all strings by content in a query mode
+ - Input
+    lpString: The string to query
+    nMode: The query mode, QUERY_MODE_*
+ - Output
+    lpMatchCount: The matched strings count
+ - Return
+    The all matched records
+*/
+const QueryRecord *QueryAllByContentEx(const wchar_t *lpString,
+    int nMode, size_t *lpMatchCount);
+
 /*
  - Description
     Fuzzy query all strings by content
@@ -129,6 +343,21 @@ const QueryRecord *QueryAllByContent(const wchar_t *lpString, size_t *lpMatchCou
 */
 const QueryRecord *FuzzyQueryAllByContent(const wchar_t *lpString, size_t *lpMatchCount);
 
+/*
+ - Description
+    Fuzzy query all strings by content in a query mode, strings are 
+    folded one by one to be searched
+ - Input
+    lpString: The string to query
+    nMode: The query mode, QUERY_MODE_*
+ - Output
+    lpMatchCount: The matched strings count
+ - Return
+    The all matched records
+*/
+const QueryRecord *FuzzyQueryAllByContentEx(const wchar_t *lpString,
+    int nMode, size_t *lpMatchCount);
+
 /*
  - Description
     Delete string by index
@@ -176,6 +405,68 @@ size_t DeleteAllByContent(const wchar_t *lpString);
 */
 bool AlterByIndex(size_t nIndex, const wchar_t *lpNewString, size_t *lpNewIndex);
 
+/*
+ - Description
+    Replace a range of string with another string. The string grows on 
+    the same place if the gap behind it is large enough, otherwise it is 
+    moved to a new place
+ - Input
+    nIndex: The index of source string
+    nOffset: The offset of range, in characters
+    nEraseCount: Number of characters to erase from offset
+    lpString: The string to insert at offset
+ - Output
+    lpNewIndex: The new string index. It can be NULL
+ - Return
+    true if successful, or false
+*/
+bool SpliceItem(size_t nIndex, size_t nOffset, size_t nEraseCount,
+    const wchar_t *lpString, size_t *lpNewIndex);
+
+/*
+ - Description
+    Append a string to the end of string
+ - Input
+    nIndex: The index of source string
+    lpSuffix: The string to append
+ - Output
+    lpNewIndex: The new string index. It can be NULL
+ - Return
+    true if successful, or false
+*/
+bool AppendToItem(size_t nIndex, const wchar_t *lpSuffix, size_t *lpNewIndex);
+
+/*
+ - Description
+    Insert a string into string at offset
+ - Input
+    nIndex: The index of source string
+    nOffset: The offset to insert, in characters
+    lpString: The string to insert
+ - Output
+    lpNewIndex: The new string index. It can be NULL
+ - Return
+    true if successful, or false
+*/
+bool InsertAtOffset(size_t nIndex, size_t nOffset,
+    const wchar_t *lpString, size_t *lpNewIndex);
+
+/*
+ - Description
+    Erase a range of string. An uncompressed string shrinks on the same
+    place, a compressed string is decompressed, it is moved to a new place
+    if the result does not fit, and fails if there is no free space
+ - Input
+    nIndex: The index of string
+    nOffset: The offset of range, in characters
+    nCount: Number of characters to erase
+ - Output
+    lpNewIndex: The new string index. It can be NULL
+ - Return
+    true if successful, or false
+*/
+bool EraseRange(size_t nIndex, size_t nOffset, size_t nCount, size_t *lpNewIndex);
+
 /*
  - Description
     Alter next matched string by content
@@ -203,6 +494,35 @@ bool AlterNextByContent(const wchar_t *lpSrcString, size_t nBeginIndex,
 */
 size_t AlterAllByContent(const wchar_t *lpSrcString, const wchar_t *lpNewString);
 
+/*
+ - Description
+    Train shared dictionary from strings in storage, to compress cold strings
+ - Return
+    true if successful, or false if there are compressed strings
+*/
+bool TrainDictionary();
+
+/*
+ - Description
+    Compress strings which are not touched for a while, by shared dictionary.
+    Dictionary is trained first if it is not trained yet. Compressed strings
+    are decompressed once when read, and kept until the database is changed, 
+    so pointers of compressed strings are valid as long as pointers of 
+    other strings. Reading a compressed string returns NULL only if there
+    is no memory to decompress it. Fuzzy queries in exact mode and 
+    Statistic read codes of compressed strings without decompressing them
+ - Input
+    nIdleTicks: Number of touches to other strings since last touch
+ - Return
+    The compressed strings count
+*/
+size_t CompressColdItems(size_t nIdleTicks);
+
+/*
+    Get compressed string count in database
+*/
+size_t GetCompressedCount();
+
 /*
  - Description
     Count the number and frequency of '0'~'9', 'A'~'Z' and 'a'~'z'
@@ -216,4 +536,103 @@ size_t AlterAllByContent(const wchar_t *lpSrcString, const wchar_t *lpNewString)
  - Other
     The counts are sorted by '0'~'9', 'A'~'Z' and 'a'~'z'
 */
-bool Statistic(size_t *lpCounts, size_t nSize, size_t *lpTotal);
\ No newline at end of file
+bool Statistic(size_t *lpCounts, size_t nSize, size_t *lpTotal);
+
+/*
+ - Description
+    Get the most frequent strings in database, estimated by Count-Min
+    sketch. Sketches are updated by storing, deleting and altering, 
+    and use fixed memory however many strings are stored
+ - Input
+    nMaxCount: The max count of items to output
+ - Output
+    lpItems: The frequent strings, sorted by count from high to low
+ - Return
+    Number of items output
+*/
+size_t GetFrequentStrings(FrequentItem *lpItems, size_t nMaxCount);
+
+/*
+ - Description
+    Get the most frequent character n-grams in strings of database
+ - Input
+    nGramLength: Number of characters in n-gram, 2 or 3
+    nMaxCount: The max count of items to output
+ - Output
+    lpItems: The frequent n-grams, sorted by count from high to low
+ - Return
+    Number of items output
+*/
+size_t GetFrequentNGrams(size_t nGramLength, FrequentItem *lpItems, size_t nMaxCount);
+
+/*
+ - Description
+    Estimate the count of a string in database without searching
+ - Input
+    lpString: The string
+ - Return
+    The estimated count, never less than the real count
+*/
+size_t EstimateStringCount(const wchar_t *lpString);
+
+/*
+    Estimate the number of distinct strings ever stored since database
+    is cleared, by HyperLogLog. Deleted strings are still counted
+*/
+size_t EstimateDistinctCount();
+
+/*
+ - Description
+    Get sequence number of the latest change event
+ - Return
+    The latest sequence number, 0 if there is no change
+*/
+size_t GetChangeSequence();
+
+/*
+ - Description
+    Copy all strings with their ids and the sequence of the latest change,
+    to mirror database by reading changes from the sequence. It must be
+    called by the thread changing database, or under its lock
+ - Return
+    The snapshot, freed by FreeSnapshot, or NULL if out of memory
+*/
+Snapshot *TakeSnapshot();
+
+/*
+ - Description
+    Free a snapshot taken by TakeSnapshot
+ - Input
+    lpSnapshot: The snapshot. It can be NULL
+*/
+void FreeSnapshot(Snapshot *lpSnapshot);
+
+/*
+ - Description
+    Read change events after a cursor. Events are kept in a ring of 
+    CHANGE_RING_SIZE, which is read without lock, so it can be called
+    while another thread is changing database
+ - Input
+    nCursor: Sequence number of the last event read
+    nMaxCount: The max count of events to read
+ - Output
+    lpEvents: The events read, in sequence
+ - Return
+    Number of events read, or CHANGE_CURSOR_LOST if events after cursor
+    are overwritten, then the mirror must be copied again
+*/
+size_t ReadChanges(size_t nCursor, ChangeEvent *lpEvents, size_t nMaxCount);
+
+/*
+ - Description
+    Read the whole string stored or altered by a change event. Strings
+    are kept in a payload arena, which is read without lock like events
+ - Input
+    lpEvent: The event read by ReadChanges, CHANGE_STORE or CHANGE_ALTER
+ - Output
+    lpBuffer: The string, buffer size is at least nLength of event
+ - Return
+    true if successful, or false if the string is overwritten by newer
+    events, then the mirror must be copied again
+*/
+bool ReadChangeData(const ChangeEvent *lpEvent, wchar_t *lpBuffer);
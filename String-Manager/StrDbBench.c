@@ -0,0 +1,267 @@
+/******************************************************
+ - FileName
+    StrDbBench.c
+ - Description
+    Load generator of string database server. Each
+    connection sends pipelined batches of store,
+    query and delete requests, then reports requests
+    per second and latency percentiles
+ - Usage
+    StrDbBench [SocketPath] [Connections] [Depth] [Requests]
+*******************************************************/
+#include "StrDbProtocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define DEFAULT_CONNECTIONS     4
+#define DEFAULT_DEPTH           32
+#define DEFAULT_REQUESTS        100000
+
+// Number of different keys of each connection
+#define KEY_COUNT               64
+
+/*
+    Load of a connection and its measurement
+*/
+typedef struct _Client
+{
+    pthread_t Thread;
+    size_t nIndex;          // Connection number
+    size_t nRequests;       // Requests to send
+    size_t nDepth;          // Requests in flight
+    uint64_t *lpLatencies;  // Latency of each request in nanoseconds
+    size_t nFailed;         // Requests not successful
+    bool bError;            // Connection broken
+} Client;
+
+static const char *g_lpSocketPath = DEFAULT_SOCKET_PATH;
+
+/*
+    Get monotonic time in nanoseconds
+*/
+static uint64_t Now()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (uint64_t)Time.tv_sec * 1000000000u + (uint64_t)Time.tv_nsec;
+}
+
+/*
+    Send all bytes
+*/
+static bool SendAll(int nSocket, const uint8_t *lpData, size_t nSize)
+{
+    while (nSize != 0)
+    {
+        ssize_t nSent = send(nSocket, lpData, nSize, MSG_NOSIGNAL);
+        if (nSent <= 0)
+        {
+            return false;
+        }
+
+        lpData += nSent;
+        nSize -= (size_t)nSent;
+    }
+
+    return true;
+}
+
+/*
+    Append a request to batch, returns its size
+*/
+static size_t PutRequest(uint8_t *lpBuffer, uint32_t nId, uint8_t nOpcode, const char *lpString)
+{
+    size_t nLength = strlen(lpString);
+    PutFrameHeader(lpBuffer, nId, nOpcode, nLength);
+    memcpy(&lpBuffer[FRAME_HEADER_SIZE], lpString, nLength);
+    return FRAME_HEADER_SIZE + nLength;
+}
+
+/*
+    Connection thread, stores, queries and deletes its keys in turn
+*/
+static void *ClientMain(void *lpParam)
+{
+    Client *lpClient = lpParam;
+    struct sockaddr_un Address = { 0 };
+    Address.sun_family = AF_UNIX;
+    strncpy(Address.sun_path, g_lpSocketPath, sizeof(Address.sun_path) - 1);
+
+    int nSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (nSocket == -1 || connect(nSocket, (struct sockaddr *)&Address, sizeof(Address)) == -1)
+    {
+        lpClient->bError = true;
+        return NULL;
+    }
+
+    static const uint8_t Opcodes[] = { OP_STORE, OP_QUERY_ALL, OP_DELETE_ALL };
+    size_t nBatchSize = lpClient->nDepth * (FRAME_HEADER_SIZE + 64);
+    uint8_t *lpBatch = malloc(nBatchSize);
+    size_t nInputCapacity = 64 * 1024, nInputSize = 0;
+    uint8_t *lpInput = malloc(nInputCapacity);
+    if (lpBatch == NULL || lpInput == NULL)
+    {
+        lpClient->bError = true;
+    }
+
+    for (size_t nSent = 0; lpClient->bError == false && nSent != lpClient->nRequests;)
+    {
+        // Send a batch without waiting
+        size_t nCount = lpClient->nRequests - nSent;
+        nCount = (nCount < lpClient->nDepth) ? nCount : lpClient->nDepth;
+
+        size_t nSize = 0;
+        for (size_t i = 0; i != nCount; ++i)
+        {
+            size_t nRequest = nSent + i;
+            char szKey[64];
+            snprintf(szKey, sizeof(szKey), "key-%zu-%zu", lpClient->nIndex, (nRequest / 3) % KEY_COUNT);
+            nSize += PutRequest(&lpBatch[nSize], (uint32_t)nRequest, Opcodes[nRequest % 3], szKey);
+        }
+
+        uint64_t nBegin = Now();
+        if (SendAll(nSocket, lpBatch, nSize) == false)
+        {
+            lpClient->bError = true;
+            break;
+        }
+
+        // Responses arrive in order, each one is timed when parsed
+        size_t nReceived = 0;
+        while (nReceived != nCount)
+        {
+            if (nInputSize == nInputCapacity)
+            {
+                nInputCapacity *= 2;
+                lpInput = realloc(lpInput, nInputCapacity);
+            }
+
+            ssize_t nRead = (lpInput != NULL) ?
+                recv(nSocket, &lpInput[nInputSize], nInputCapacity - nInputSize, 0) : -1;
+            if (nRead <= 0)
+            {
+                lpClient->bError = true;
+                break;
+            }
+
+            nInputSize += (size_t)nRead;
+            size_t nOffset = 0;
+            uint64_t nEnd = Now();
+            size_t nFrameSize = 0;
+            int nResult = FRAME_PARTIAL;
+            while ((nResult = ParseFrame(&lpInput[nOffset], nInputSize - nOffset, &nFrameSize))
+                == FRAME_COMPLETE)
+            {
+                // Only ids of this batch are answered
+                uint32_t nId = GetUint32(&lpInput[nOffset + 4]);
+                if (nId < nSent || nId >= nSent + nCount)
+                {
+                    lpClient->bError = true;
+                    break;
+                }
+                else if (lpInput[nOffset + 8] != STATUS_OK)
+                {
+                    ++lpClient->nFailed;
+                }
+
+                lpClient->lpLatencies[nId] = nEnd - nBegin;
+                nOffset += 4 + nFrameSize;
+                ++nReceived;
+            }
+
+            if (nResult == FRAME_INVALID)
+            {
+                lpClient->bError = true;
+            }
+
+            memmove(lpInput, &lpInput[nOffset], nInputSize - nOffset);
+            nInputSize -= nOffset;
+            if (lpClient->bError == true)
+            {
+                break;
+            }
+        }
+
+        nSent += nCount;
+    }
+
+    free(lpBatch);
+    free(lpInput);
+    close(nSocket);
+    return NULL;
+}
+
+/*
+    Sort latencies from low to high
+*/
+static int CompareLatency(const void *lpLeft, const void *lpRight)
+{
+    uint64_t nA = *(const uint64_t *)lpLeft, nB = *(const uint64_t *)lpRight;
+    return (nA > nB) - (nA < nB);
+}
+
+int main(int argc, char *argv[])
+{
+    g_lpSocketPath = (argc > 1) ? argv[1] : DEFAULT_SOCKET_PATH;
+    size_t nConnections = (argc > 2) ? strtoul(argv[2], NULL, 10) : DEFAULT_CONNECTIONS;
+    size_t nDepth = (argc > 3) ? strtoul(argv[3], NULL, 10) : DEFAULT_DEPTH;
+    size_t nRequests = (argc > 4) ? strtoul(argv[4], NULL, 10) : DEFAULT_REQUESTS;
+    if (nConnections == 0 || nDepth == 0 || nRequests == 0)
+    {
+        fprintf(stderr, "Usage: %s [SocketPath] [Connections] [Depth] [Requests]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Client *lpClients = calloc(nConnections, sizeof(Client));
+    uint64_t *lpLatencies = calloc(nConnections * nRequests, sizeof(uint64_t));
+    if (lpClients == NULL || lpLatencies == NULL)
+    {
+        fprintf(stderr, "No memory\n");
+        return EXIT_FAILURE;
+    }
+
+    uint64_t nBegin = Now();
+    for (size_t i = 0; i != nConnections; ++i)
+    {
+        lpClients[i].nIndex = i;
+        lpClients[i].nRequests = nRequests;
+        lpClients[i].nDepth = nDepth;
+        lpClients[i].lpLatencies = &lpLatencies[i * nRequests];
+        pthread_create(&lpClients[i].Thread, NULL, ClientMain, &lpClients[i]);
+    }
+
+    size_t nFailed = 0;
+    for (size_t i = 0; i != nConnections; ++i)
+    {
+        pthread_join(lpClients[i].Thread, NULL);
+        if (lpClients[i].bError == true)
+        {
+            fprintf(stderr, "Connection %zu is broken\n", i);
+            return EXIT_FAILURE;
+        }
+
+        nFailed += lpClients[i].nFailed;
+    }
+
+    double dSeconds = (double)(Now() - nBegin) / 1e9;
+    size_t nTotal = nConnections * nRequests;
+    qsort(lpLatencies, nTotal, sizeof(uint64_t), CompareLatency);
+
+    printf("Requests:   %zu (%zu not successful)\n", nTotal, nFailed);
+    printf("Throughput: %.0f requests/s\n", (double)nTotal / dSeconds);
+    printf("Latency:    p50 %.1f us, p99 %.1f us, max %.1f us\n",
+        (double)lpLatencies[nTotal / 2] / 1e3,
+        (double)lpLatencies[nTotal * 99 / 100] / 1e3,
+        (double)lpLatencies[nTotal - 1] / 1e3);
+
+    free(lpLatencies);
+    free(lpClients);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,668 @@
+/**************************************************
+ - FileName
+    StrDbCodec.c
+ - Description
+    Codecs of string database
+***************************************************/
+#include "StrDbCodec.h"
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <assert.h>
+
+/*
+    Candidate symbol counted in training
+*/
+typedef struct _Candidate
+{
+    Symbol Sym;
+    size_t nCount;      // Occurrences in samples, 0 if slot is empty
+    size_t nGain;       // Bytes saved when encoded as symbol
+} Candidate;
+
+/*
+    Cursor to read folded characters of a string one by one
+*/
+typedef struct _FoldCursor
+{
+    const wchar_t *lpString;
+    size_t nLength;     // Number of characters, not including '\0'
+    size_t nPosition;   // Next character to read
+    bool bNormalize;    // Whether strip diacritics and collapse white spaces
+    bool bSpace;        // White spaces skipped, not output yet
+    bool bStarted;      // Any character output, leading white spaces are dropped
+    wchar_t cPending;   // Character to output after a collapsed white space
+} FoldCursor;
+
+// Base letters of U+00C0~U+00FF and U+0100~U+017F, '.' if there is none
+static const char g_szLatin1Bases[] =
+    "aaaaaa.ceeeeiiii.nooooo.ouuuuy.."
+    "aaaaaa.ceeeeiiii.nooooo.ouuuuy.y";
+static const char g_szLatinExtBases[] =
+    "aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiii..jjkk."
+    "llllllllllnnnnnn...oooooo..rrrrrrssssssssttttttuuuuuuuuuuuuwwyyyzzzzzzs";
+
+/*
+    Hash symbol characters
+*/
+static size_t HashSymbol(const wchar_t *lpData, size_t nLength)
+{
+    size_t nHash = 2166136261u;
+    for (size_t i = 0; i != nLength; ++i)
+    {
+        nHash = (nHash ^ (size_t)lpData[i]) * 16777619u;
+    }
+
+    return nHash;
+}
+
+/*
+    Count a candidate symbol
+*/
+static void CountCandidate(Candidate *lpTable, const wchar_t *lpData, size_t nLength)
+{
+    size_t nSlot = HashSymbol(lpData, nLength) & (TRAINING_TABLE_SIZE - 1);
+    for (size_t i = 0; i != TRAINING_TABLE_SIZE; ++i)
+    {
+        Candidate *lpCandidate = &lpTable[nSlot];
+        if (lpCandidate->nCount == 0)
+        {
+            wmemcpy(lpCandidate->Sym.szData, lpData, nLength);
+            lpCandidate->Sym.nLength = nLength;
+            lpCandidate->nCount = 1;
+            return;
+        }
+        else if (lpCandidate->Sym.nLength == nLength
+            && wmemcmp(lpCandidate->Sym.szData, lpData, nLength) == 0)
+        {
+            ++lpCandidate->nCount;
+            return;
+        }
+
+        nSlot = (nSlot + 1) & (TRAINING_TABLE_SIZE - 1);
+    }
+
+    // Table is full, ignore new candidates
+}
+
+/*
+    Sort candidates by gain from high to low
+*/
+static int CompareGain(const void *lpLeft, const void *lpRight)
+{
+    const Candidate *lpA = lpLeft, *lpB = lpRight;
+    return (lpA->nGain < lpB->nGain) - (lpA->nGain > lpB->nGain);
+}
+
+/*
+    Sort symbols by length from long to short
+*/
+static int CompareLength(const void *lpLeft, const void *lpRight)
+{
+    const Symbol *lpA = lpLeft, *lpB = lpRight;
+    return (lpA->nLength < lpB->nLength) - (lpA->nLength > lpB->nLength);
+}
+
+/*
+    Train symbol table from samples
+*/
+bool TrainSymbolTable(SymbolTable *lpTable, const wchar_t *lpSamples, size_t nSampleSize)
+{
+    assert(lpTable != NULL);
+    assert(lpSamples != NULL);
+
+    Candidate *lpCandidates = calloc(TRAINING_TABLE_SIZE, sizeof(Candidate));
+    if (lpCandidates == NULL)
+    {
+        return false;
+    }
+
+    // Count every substring up to SYMBOL_MAX_LENGTH, never across '\0'
+    for (size_t i = 0; i != nSampleSize; ++i)
+    {
+        for (size_t j = 1; j <= SYMBOL_MAX_LENGTH && i + j <= nSampleSize; ++j)
+        {
+            if (lpSamples[i + j - 1] == L'\0')
+            {
+                break;
+            }
+
+            CountCandidate(lpCandidates, &lpSamples[i], j);
+        }
+    }
+
+    // An escaped character takes 1 + sizeof(wchar_t) bytes, a symbol takes 1 byte
+    size_t nUsed = 0;
+    for (size_t i = 0; i != TRAINING_TABLE_SIZE; ++i)
+    {
+        if (lpCandidates[i].nCount != 0)
+        {
+            lpCandidates[nUsed] = lpCandidates[i];
+            lpCandidates[nUsed].nGain = lpCandidates[nUsed].nCount
+                * (lpCandidates[nUsed].Sym.nLength * (1 + sizeof(wchar_t)) - 1);
+            ++nUsed;
+        }
+    }
+
+    qsort(lpCandidates, nUsed, sizeof(Candidate), CompareGain);
+
+    lpTable->nCount = (nUsed < MAX_SYMBOL_COUNT) ? nUsed : MAX_SYMBOL_COUNT;
+    for (size_t i = 0; i != lpTable->nCount; ++i)
+    {
+        lpTable->Symbols[i] = lpCandidates[i].Sym;
+    }
+
+    // Greedy encoding takes the first matched, which is the longest
+    qsort(lpTable->Symbols, lpTable->nCount, sizeof(Symbol), CompareLength);
+
+    free(lpCandidates);
+    return lpTable->nCount != 0;
+}
+
+/*
+    Encode string by symbol table
+*/
+size_t EncodeString(const SymbolTable *lpTable, const wchar_t *lpString,
+    size_t nLength, uint8_t *lpOutput, size_t nOutputSize)
+{
+    assert(lpTable != NULL);
+    assert(lpString != NULL);
+    assert(lpOutput != NULL);
+
+    size_t nSize = 0;
+    for (size_t i = 0; i != nLength;)
+    {
+        size_t nCode = ESCAPE_CODE;
+        for (size_t j = 0; j != lpTable->nCount; ++j)
+        {
+            const Symbol *lpSymbol = &lpTable->Symbols[j];
+            if (lpSymbol->nLength <= nLength - i
+                && wmemcmp(lpSymbol->szData, &lpString[i], lpSymbol->nLength) == 0)
+            {
+                nCode = j;
+                break;
+            }
+        }
+
+        if (nCode != ESCAPE_CODE)
+        {
+            if (nSize + 1 > nOutputSize)
+            {
+                return 0;
+            }
+
+            lpOutput[nSize++] = (uint8_t)nCode;
+            i += lpTable->Symbols[nCode].nLength;
+        }
+        else
+        {
+            if (nSize + 1 + sizeof(wchar_t) > nOutputSize)
+            {
+                return 0;
+            }
+
+            lpOutput[nSize++] = ESCAPE_CODE;
+            memcpy(&lpOutput[nSize], &lpString[i], sizeof(wchar_t));
+            nSize += sizeof(wchar_t);
+            ++i;
+        }
+    }
+
+    return nSize;
+}
+
+/*
+    Decode codes to string by symbol table
+*/
+size_t DecodeString(const SymbolTable *lpTable, const uint8_t *lpInput,
+    size_t nInputSize, wchar_t *lpOutput, size_t nOutputSize)
+{
+    assert(lpTable != NULL);
+    assert(lpInput != NULL);
+    assert(lpOutput != NULL);
+
+    size_t nLength = 0;
+    for (size_t i = 0; i != nInputSize;)
+    {
+        if (lpInput[i] == ESCAPE_CODE)
+        {
+            assert(nLength + 1 <= nOutputSize);
+
+            memcpy(&lpOutput[nLength], &lpInput[i + 1], sizeof(wchar_t));
+            ++nLength;
+            i += 1 + sizeof(wchar_t);
+        }
+        else
+        {
+            const Symbol *lpSymbol = &lpTable->Symbols[lpInput[i]];
+            assert(nLength + lpSymbol->nLength <= nOutputSize);
+
+            wmemcpy(&lpOutput[nLength], lpSymbol->szData, lpSymbol->nLength);
+            nLength += lpSymbol->nLength;
+            ++i;
+        }
+    }
+
+    return nLength;
+}
+
+/*
+    Step matcher state by one character
+*/
+static size_t StepMatcher(const CodeMatcher *lpMatcher, size_t nState, wchar_t cChar)
+{
+    while (nState != 0 && lpMatcher->szPattern[nState] != cChar)
+    {
+        nState = lpMatcher->nFailure[nState];
+    }
+
+    return (lpMatcher->szPattern[nState] == cChar) ? nState + 1 : 0;
+}
+
+/*
+    Prepare a pattern to be searched in codes
+*/
+bool InitCodeMatcher(CodeMatcher *lpMatcher, const SymbolTable *lpTable,
+    const wchar_t *lpPattern, size_t nLength)
+{
+    assert(lpMatcher != NULL);
+    assert(lpTable != NULL);
+    assert(lpPattern != NULL);
+
+    if (nLength > MATCHER_MAX_LENGTH)
+    {
+        return false;
+    }
+
+    lpMatcher->lpTable = lpTable;
+    lpMatcher->nLength = nLength;
+    wmemcpy(lpMatcher->szPattern, lpPattern, nLength);
+    memset(lpMatcher->nNext, MATCHER_UNKNOWN, sizeof(lpMatcher->nNext));
+
+    // Failure of each state is the longest proper border of matched prefix
+    memset(lpMatcher->nFailure, 0, sizeof(lpMatcher->nFailure));
+    for (size_t i = 2; i < nLength; ++i)
+    {
+        lpMatcher->nFailure[i] = (uint8_t)StepMatcher(lpMatcher,
+            lpMatcher->nFailure[i - 1], lpPattern[i - 1]);
+    }
+
+    return true;
+}
+
+/*
+    Search pattern in codes without decoding them
+*/
+bool MatchCodes(CodeMatcher *lpMatcher, const uint8_t *lpInput, size_t nInputSize)
+{
+    assert(lpMatcher != NULL);
+    assert(lpInput != NULL);
+
+    if (lpMatcher->nLength == 0)
+    {
+        return true;
+    }
+
+    size_t nState = 0;
+    for (size_t i = 0; i != nInputSize;)
+    {
+        if (lpInput[i] == ESCAPE_CODE)
+        {
+            wchar_t cChar;
+            memcpy(&cChar, &lpInput[i + 1], sizeof(wchar_t));
+            nState = StepMatcher(lpMatcher, nState, cChar);
+            i += 1 + sizeof(wchar_t);
+        }
+        else
+        {
+            // A symbol may complete the pattern in its middle
+            uint8_t *lpNext = &lpMatcher->nNext[nState][lpInput[i]];
+            if (*lpNext == MATCHER_UNKNOWN)
+            {
+                const Symbol *lpSymbol = &lpMatcher->lpTable->Symbols[lpInput[i]];
+                size_t nNext = nState;
+                for (size_t j = 0; j != lpSymbol->nLength && nNext != lpMatcher->nLength; ++j)
+                {
+                    nNext = StepMatcher(lpMatcher, nNext, lpSymbol->szData[j]);
+                }
+
+                *lpNext = (uint8_t)nNext;
+            }
+
+            nState = *lpNext;
+            ++i;
+        }
+
+        if (nState == lpMatcher->nLength)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+    Decode UTF-8 text to string
+*/
+size_t DecodeUtf8(const uint8_t *lpInput, size_t nInputSize,
+    wchar_t *lpOutput, size_t nOutputSize)
+{
+    assert(lpInput != NULL);
+    assert(lpOutput != NULL);
+
+    size_t nLength = 0;
+    for (size_t i = 0; i != nInputSize;)
+    {
+        uint32_t nCode = lpInput[i++];
+        if (nCode < 0x80)
+        {
+            if (nLength == nOutputSize)
+            {
+                return SIZE_MAX;
+            }
+
+            lpOutput[nLength++] = (wchar_t)nCode;
+            continue;
+        }
+
+        // The second byte range rejects overlong forms, surrogates
+        // and values above U+10FFFF
+        size_t nExtra = 0;
+        uint8_t nLower = 0x80, nUpper = 0xBF;
+        if (0xC2 <= nCode && nCode <= 0xDF)
+        {
+            nExtra = 1;
+            nCode &= 0x1F;
+        }
+        else if (0xE0 <= nCode && nCode <= 0xEF)
+        {
+            nExtra = 2;
+            nLower = (nCode == 0xE0) ? 0xA0 : 0x80;
+            nUpper = (nCode == 0xED) ? 0x9F : 0xBF;
+            nCode &= 0x0F;
+        }
+        else if (0xF0 <= nCode && nCode <= 0xF4)
+        {
+            nExtra = 3;
+            nLower = (nCode == 0xF0) ? 0x90 : 0x80;
+            nUpper = (nCode == 0xF4) ? 0x8F : 0xBF;
+            nCode &= 0x07;
+        }
+        else
+        {
+            nCode = 0xFFFD;
+        }
+
+        for (size_t j = 0; j != nExtra; ++j, ++i)
+        {
+            if (i == nInputSize || lpInput[i] < nLower || lpInput[i] > nUpper)
+            {
+                // Invalid or truncated sequence, the byte is decoded again
+                nCode = 0xFFFD;
+                break;
+            }
+
+            nCode = (nCode << 6) | (lpInput[i] & 0x3F);
+            nLower = 0x80;
+            nUpper = 0xBF;
+        }
+
+        if (sizeof(wchar_t) == 2 && nCode > 0xFFFF)
+        {
+            // UTF-16 surrogate pair
+            if (nLength + 2 > nOutputSize)
+            {
+                return SIZE_MAX;
+            }
+
+            nCode -= 0x10000;
+            lpOutput[nLength++] = (wchar_t)(0xD800 + (nCode >> 10));
+            lpOutput[nLength++] = (wchar_t)(0xDC00 + (nCode & 0x3FF));
+        }
+        else
+        {
+            if (nLength == nOutputSize)
+            {
+                return SIZE_MAX;
+            }
+
+            lpOutput[nLength++] = (wchar_t)nCode;
+        }
+    }
+
+    return nLength;
+}
+
+/*
+    Encode string to UTF-8 text
+*/
+size_t EncodeUtf8(const wchar_t *lpString, size_t nLength,
+    uint8_t *lpOutput, size_t nOutputSize)
+{
+    assert(lpString != NULL);
+    assert(lpOutput != NULL);
+
+    size_t nSize = 0;
+    for (size_t i = 0; i != nLength; ++i)
+    {
+        uint32_t nCode = (uint32_t)lpString[i];
+        if (sizeof(wchar_t) == 2 && 0xD800 <= nCode && nCode <= 0xDBFF
+            && i + 1 != nLength && 0xDC00 <= (uint32_t)lpString[i + 1]
+            && (uint32_t)lpString[i + 1] <= 0xDFFF)
+        {
+            // UTF-16 surrogate pair
+            nCode = 0x10000 + ((nCode - 0xD800) << 10) + ((uint32_t)lpString[++i] - 0xDC00);
+        }
+
+        size_t nBytes = (nCode < 0x80) ? 1 : (nCode < 0x800) ? 2 : (nCode < 0x10000) ? 3 : 4;
+        if (nSize + nBytes > nOutputSize)
+        {
+            return SIZE_MAX;
+        }
+
+        switch (nBytes)
+        {
+        case 1:
+            lpOutput[nSize++] = (uint8_t)nCode;
+            break;
+        case 2:
+            lpOutput[nSize++] = (uint8_t)(0xC0 | (nCode >> 6));
+            lpOutput[nSize++] = (uint8_t)(0x80 | (nCode & 0x3F));
+            break;
+        case 3:
+            lpOutput[nSize++] = (uint8_t)(0xE0 | (nCode >> 12));
+            lpOutput[nSize++] = (uint8_t)(0x80 | ((nCode >> 6) & 0x3F));
+            lpOutput[nSize++] = (uint8_t)(0x80 | (nCode & 0x3F));
+            break;
+        default:
+            lpOutput[nSize++] = (uint8_t)(0xF0 | (nCode >> 18));
+            lpOutput[nSize++] = (uint8_t)(0x80 | ((nCode >> 12) & 0x3F));
+            lpOutput[nSize++] = (uint8_t)(0x80 | ((nCode >> 6) & 0x3F));
+            lpOutput[nSize++] = (uint8_t)(0x80 | (nCode & 0x3F));
+            break;
+        }
+    }
+
+    return nSize;
+}
+
+/*
+    Fold case of a character by simple case folding, covering Latin-1,
+    Latin Extended-A, Latin Extended Additional, Greek and Cyrillic letters
+*/
+static wchar_t FoldChar(wchar_t cChar)
+{
+    uint32_t nCode = (uint32_t)cChar;
+    if ((nCode >= 'A' && nCode <= 'Z')
+        || (nCode >= 0xC0 && nCode <= 0xDE && nCode != 0xD7)
+        || (nCode >= 0x391 && nCode <= 0x3AB && nCode != 0x3A2)
+        || (nCode >= 0x410 && nCode <= 0x42F))
+    {
+        return (wchar_t)(nCode + 0x20);
+    }
+    else if (nCode >= 0x400 && nCode <= 0x40F)
+    {
+        return (wchar_t)(nCode + 0x50);
+    }
+    else if (nCode == 0x178)
+    {
+        return (wchar_t)0xFF;
+    }
+    else if (nCode == 0x386)
+    {
+        return (wchar_t)0x3AC;
+    }
+    else if (nCode >= 0x388 && nCode <= 0x38A)
+    {
+        return (wchar_t)(nCode + 0x25);
+    }
+    else if (nCode == 0x38C)
+    {
+        return (wchar_t)0x3CC;
+    }
+    else if (nCode == 0x38E || nCode == 0x38F)
+    {
+        return (wchar_t)(nCode + 0x3F);
+    }
+    else if (nCode == 0x3C2)
+    {
+        // Final sigma
+        return (wchar_t)0x3C3;
+    }
+
+    // Upper and lower letters in pairs, upper letters are even codes
+    // except U+0139~U+0148, U+0179~U+017E and U+04C1~U+04CE
+    bool bEvenPairs = (nCode >= 0x100 && nCode <= 0x137 && nCode != 0x130 && nCode != 0x131)
+        || (nCode >= 0x14A && nCode <= 0x177)
+        || (nCode >= 0x460 && nCode <= 0x481) || (nCode >= 0x48A && nCode <= 0x4BF)
+        || (nCode >= 0x4D0 && nCode <= 0x52F)
+        || (nCode >= 0x1E00 && nCode <= 0x1E95) || (nCode >= 0x1EA0 && nCode <= 0x1EFF);
+    bool bOddPairs = (nCode >= 0x139 && nCode <= 0x148) || (nCode >= 0x179 && nCode <= 0x17E)
+        || (nCode >= 0x4C1 && nCode <= 0x4CE);
+    if ((bEvenPairs == true && (nCode & 1) == 0) || (bOddPairs == true && (nCode & 1) == 1))
+    {
+        return (wchar_t)(nCode + 1);
+    }
+
+    return cChar;
+}
+
+/*
+    Map a folded character to its compatible base character
+*/
+static wchar_t StripChar(wchar_t cChar)
+{
+    uint32_t nCode = (uint32_t)cChar;
+    if (nCode >= 0xC0 && nCode <= 0xFF && g_szLatin1Bases[nCode - 0xC0] != '.')
+    {
+        return (wchar_t)g_szLatin1Bases[nCode - 0xC0];
+    }
+    else if (nCode >= 0x100 && nCode <= 0x17F && g_szLatinExtBases[nCode - 0x100] != '.')
+    {
+        return (wchar_t)g_szLatinExtBases[nCode - 0x100];
+    }
+    else if (nCode >= 0xFF01 && nCode <= 0xFF5E)
+    {
+        // Full width ASCII, folded again for upper letters
+        return FoldChar((wchar_t)(nCode - 0xFEE0));
+    }
+
+    return cChar;
+}
+
+/*
+    Check whether a character is white space
+*/
+static bool IsSpaceChar(wchar_t cChar)
+{
+    uint32_t nCode = (uint32_t)cChar;
+    return (nCode >= 0x09 && nCode <= 0x0D) || nCode == 0x20 || nCode == 0x85 
+        || nCode == 0xA0 || nCode == 0x1680 || (nCode >= 0x2000 && nCode <= 0x200A)
+        || nCode == 0x2028 || nCode == 0x2029 || nCode == 0x202F || nCode == 0x205F
+        || nCode == 0x3000;
+}
+
+/*
+    Read next folded character, returns false at the end
+*/
+static bool NextFoldedChar(FoldCursor *lpCursor, wchar_t *lpChar)
+{
+    if (lpCursor->cPending != L'\0')
+    {
+        *lpChar = lpCursor->cPending;
+        lpCursor->cPending = L'\0';
+        return true;
+    }
+
+    while (lpCursor->nPosition != lpCursor->nLength)
+    {
+        wchar_t cChar = lpCursor->lpString[lpCursor->nPosition++];
+        if (lpCursor->bNormalize == false)
+        {
+            *lpChar = FoldChar(cChar);
+            return true;
+        }
+        else if (IsSpaceChar(cChar) == true)
+        {
+            lpCursor->bSpace = true;
+            continue;
+        }
+        else if ((uint32_t)cChar >= 0x300 && (uint32_t)cChar <= 0x36F)
+        {
+            // Combining diacritical marks of decomposed letters
+            continue;
+        }
+
+        cChar = StripChar(FoldChar(cChar));
+        if (lpCursor->bSpace == true && lpCursor->bStarted == true)
+        {
+            // A run of white spaces is output as one space
+            lpCursor->cPending = cChar;
+            cChar = L' ';
+        }
+
+        lpCursor->bSpace = false;
+        lpCursor->bStarted = true;
+        *lpChar = cChar;
+        return true;
+    }
+
+    return false;
+}
+
+/*
+    Fold string for case insensitive comparing
+*/
+size_t FoldString(const wchar_t *lpString, size_t nLength, bool bNormalize, wchar_t *lpOutput)
+{
+    assert(lpString != NULL);
+    assert(lpOutput != NULL);
+
+    FoldCursor Cursor = { lpString, nLength, 0, bNormalize, false, false, L'\0' };
+    size_t nFoldLength = 0;
+    while (NextFoldedChar(&Cursor, &lpOutput[nFoldLength]) == true)
+    {
+        ++nFoldLength;
+    }
+
+    return nFoldLength;
+}
+
+/*
+    Hash folded string
+*/
+uint32_t HashFoldedString(const wchar_t *lpString, size_t nLength, bool bNormalize)
+{
+    assert(lpString != NULL);
+
+    FoldCursor Cursor = { lpString, nLength, 0, bNormalize, false, false, L'\0' };
+    uint32_t nHash = 2166136261u;
+    wchar_t cChar = L'\0';
+    while (NextFoldedChar(&Cursor, &cChar) == true)
+    {
+        nHash = (nHash ^ (uint32_t)cChar) * 16777619u;
+    }
+
+    return nHash;
+}
@@ -0,0 +1,193 @@
+/**************************************************
+ - FileName
+    StrDbCodec.h
+ - Description
+    Codecs of string database, the symbol table
+    codec to compress cold strings, each symbol of
+    a shared dictionary is encoded as one byte code,
+    UTF-8 codec for text files, and folding for
+    case insensitive queries
+***************************************************/
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// The longest symbol in characters
+#define SYMBOL_MAX_LENGTH   8
+
+// Code 0xFF is an escape, followed by a raw character
+#define MAX_SYMBOL_COUNT    255
+#define ESCAPE_CODE         0xFF
+
+// Candidate symbols counted in training, must be power of 2
+#define TRAINING_TABLE_SIZE 16384
+
+// The longest pattern searched in codes, must be less than 0xFF
+#define MATCHER_MAX_LENGTH  64
+#define MATCHER_UNKNOWN     0xFF
+
+/*
+    A symbol of dictionary
+*/
+typedef struct _Symbol
+{
+    wchar_t szData[SYMBOL_MAX_LENGTH];  // Symbol characters, not terminated
+    size_t nLength;                     // Number of characters in symbol
+} Symbol;
+
+/*
+    Shared dictionary, symbols are sorted by length from long to short
+*/
+typedef struct _SymbolTable
+{
+    Symbol Symbols[MAX_SYMBOL_COUNT];
+    size_t nCount;
+} SymbolTable;
+
+/*
+    Pattern searched in codes without decoding them. Each state is the
+    number of pattern characters matched, and the state after a symbol 
+    is computed once it is met
+*/
+typedef struct _CodeMatcher
+{
+    const SymbolTable *lpTable;
+    wchar_t szPattern[MATCHER_MAX_LENGTH];
+    size_t nLength;
+    uint8_t nFailure[MATCHER_MAX_LENGTH];   // State to fall back on mismatch
+    uint8_t nNext[MATCHER_MAX_LENGTH][MAX_SYMBOL_COUNT];    // MATCHER_UNKNOWN if not computed
+} CodeMatcher;
+
+/*
+ - Description
+    Train symbol table from samples
+ - Input
+    lpSamples: Sample strings, separated by '\0'
+    nSampleSize: Number of characters in samples
+ - Output
+    lpTable: The trained symbol table
+ - Return
+    true if successful, or false
+*/
+bool TrainSymbolTable(SymbolTable *lpTable, const wchar_t *lpSamples, size_t nSampleSize);
+
+/*
+ - Description
+    Encode string by symbol table
+ - Input
+    lpTable: The symbol table
+    lpString: The string to encode
+    nLength: Number of characters to encode, not including '\0'
+    nOutputSize: The output buffer size in bytes
+ - Output
+    lpOutput: The encoded codes
+ - Return
+    Number of bytes encoded, or 0 if output buffer is not enough
+*/
+size_t EncodeString(const SymbolTable *lpTable, const wchar_t *lpString,
+    size_t nLength, uint8_t *lpOutput, size_t nOutputSize);
+
+/*
+ - Description
+    Decode codes to string by symbol table
+ - Input
+    lpTable: The symbol table
+    lpInput: The codes to decode
+    nInputSize: Number of bytes to decode
+    nOutputSize: The output buffer size in characters
+ - Output
+    lpOutput: The decoded string, not terminated
+ - Return
+    Number of characters decoded
+*/
+size_t DecodeString(const SymbolTable *lpTable, const uint8_t *lpInput,
+    size_t nInputSize, wchar_t *lpOutput, size_t nOutputSize);
+
+/*
+ - Description
+    Prepare a pattern to be searched in codes
+ - Input
+    lpTable: The symbol table codes are encoded by
+    lpPattern: The pattern to search
+    nLength: Number of characters in pattern, not including '\0'
+ - Output
+    lpMatcher: The prepared matcher
+ - Return
+    true if successful, or false if pattern is longer than MATCHER_MAX_LENGTH
+*/
+bool InitCodeMatcher(CodeMatcher *lpMatcher, const SymbolTable *lpTable,
+    const wchar_t *lpPattern, size_t nLength);
+
+/*
+ - Description
+    Search pattern in codes without decoding them
+ - Input
+    lpMatcher: The matcher prepared by InitCodeMatcher
+    lpInput: The codes to search
+    nInputSize: Number of bytes to search
+ - Return
+    true if decoded string contains the pattern, or false
+*/
+bool MatchCodes(CodeMatcher *lpMatcher, const uint8_t *lpInput, size_t nInputSize);
+
+/*
+ - Description
+    Decode UTF-8 text to string. Invalid bytes, overlong forms, surrogates
+    and values above U+10FFFF are decoded as U+FFFD
+ - Input
+    lpInput: The UTF-8 text
+    nInputSize: Number of bytes to decode
+    nOutputSize: The output buffer size in characters
+ - Output
+    lpOutput: The decoded string, not terminated
+ - Return
+    Number of characters decoded, or SIZE_MAX if output buffer is not enough
+*/
+size_t DecodeUtf8(const uint8_t *lpInput, size_t nInputSize,
+    wchar_t *lpOutput, size_t nOutputSize);
+
+/*
+ - Description
+    Encode string to UTF-8 text
+ - Input
+    lpString: The string to encode
+    nLength: Number of characters to encode, not including '\0'
+    nOutputSize: The output buffer size in bytes
+ - Output
+    lpOutput: The UTF-8 text, not terminated
+ - Return
+    Number of bytes encoded, or SIZE_MAX if output buffer is not enough
+*/
+size_t EncodeUtf8(const wchar_t *lpString, size_t nLength,
+    uint8_t *lpOutput, size_t nOutputSize);
+
+/*
+ - Description
+    Fold string for case insensitive comparing. Letters are case folded,
+    and if normalized, diacritics of Latin letters are stripped, full width
+    ASCII is mapped to ASCII, runs of white spaces are collapsed to one
+    space and leading or trailing white spaces are dropped
+ - Input
+    lpString: The string to fold
+    nLength: Number of characters to fold, not including '\0'
+    bNormalize: Whether to normalize besides case folding
+ - Output
+    lpOutput: The folded string, not terminated, at most nLength characters
+ - Return
+    Number of characters folded
+*/
+size_t FoldString(const wchar_t *lpString, size_t nLength, bool bNormalize, wchar_t *lpOutput);
+
+/*
+ - Description
+    Hash folded string without folding it to a buffer, equal folded
+    strings have equal hashes
+ - Input
+    lpString: The string to hash
+    nLength: Number of characters to hash, not including '\0'
+    bNormalize: Whether to normalize besides case folding
+ - Return
+    The hash of folded string
+*/
+uint32_t HashFoldedString(const wchar_t *lpString, size_t nLength, bool bNormalize);
@@ -5,40 +5,148 @@
     String database, the kernel module of manager
 ***************************************************/
 #include "StrDbKernel.h"
-#include "StrDb.h"
+#include <stdlib.h>
 #include <string.h>
+#include <wchar.h>
+#include <time.h>
 #include <assert.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #pragma warning(disable:4996) 
 #pragma warning(disable:4018) 
 
 // Min array size to store '0'~'9', 'a'~'z' and 'A'~'Z' counts
 #define MIN_STAT_SIZE   62
 
-// String storage
-static wchar_t      g_szStorage[STORAGE_SIZE] = { L'\0' };
-static size_t       g_nUsedSize = 0;
+// Database used when no database is selected
+static Database     g_DefaultDatabase = { .nLargeThreshold = LARGE_STRING_THRESHOLD };
+
+// Database selected by current thread
+static THREAD_LOCAL Database *g_lpDb = &g_DefaultDatabase;
+
+/*
+    Resolve the string pointer of an index
+*/
+wchar_t *_IndexData(const Index *lpIndex)
+{
+    assert(lpIndex != NULL);
+
+    if (lpIndex->nOffset < STORAGE_SIZE)
+    {
+        return &g_lpDb->szStorage[lpIndex->nOffset];
+    }
+    else
+    {
+        return &g_lpDb->szLargeStorage[lpIndex->nOffset - STORAGE_SIZE];
+    }
+}
+
+/*
+    Get the number of characters in string of an index
+*/
+size_t _ItemLength(const Index *lpIndex)
+{
+    assert(lpIndex != NULL);
+
+    if (lpIndex->bCompressed == true)
+    {
+        return (size_t)_IndexData(lpIndex)[0];
+    }
+    else
+    {
+        return lpIndex->nLength;
+    }
+}
+
+/*
+    Update the touch time of string
+*/
+void TouchItem(size_t nIndex)
+{
+    assert(nIndex < g_lpDb->nCount);
+
+    g_lpDb->nTouchTab[nIndex] = ++g_lpDb->nClock;
+}
+
+/*
+    Compute the folded keys of string
+*/
+void SetFoldKeys(size_t nIndex, const wchar_t *lpString, size_t nLength)
+{
+    assert(nIndex < MAX_STRING_COUNT);
+    assert(lpString != NULL);
+
+    g_lpDb->nCaseKeyTab[nIndex] = HashFoldedString(lpString, nLength - 1, false);
+    g_lpDb->nNormKeyTab[nIndex] = HashFoldedString(lpString, nLength - 1, true);
+}
+
+/*
+    Uncount string of an index in sketches
+*/
+void RemoveItemFromSketches(const Index *lpIndex)
+{
+    assert(lpIndex != NULL);
+
+    const wchar_t *lpData = _IndexData(lpIndex);
+    if (lpIndex->bCompressed == true)
+    {
+        DecodeItem(lpIndex, g_lpDb->szThawBuffer);
+        lpData = g_lpDb->szThawBuffer;
+    }
+
+    RemoveFromSketches(&g_lpDb->Sketches, lpData, _ItemLength(lpIndex) - 1);
+}
+
+/*
+    Fold string of an index to buffer
+*/
+size_t FoldItem(const Index *lpIndex, bool bNormalize, wchar_t *lpOutput)
+{
+    assert(lpIndex != NULL);
+    assert(lpOutput != NULL);
 
-// String index table, to locate all strings in storage
-static Index        g_IdxTab[MAX_STRING_COUNT] = { 0 };
-static size_t       g_nCount = 0;
+    const wchar_t *lpData = _IndexData(lpIndex);
+    if (lpIndex->bCompressed == true)
+    {
+        DecodeItem(lpIndex, g_lpDb->szThawBuffer);
+        lpData = g_lpDb->szThawBuffer;
+    }
 
-// Record string query results
-static QueryRecord  g_QueryRecords[MAX_STRING_COUNT] = { 0 };
+    size_t nLength = FoldString(lpData, _ItemLength(lpIndex) - 1, bNormalize, lpOutput);
+    lpOutput[nLength] = L'\0';
+    return nLength;
+}
 
 /*
     Get string by index
 */
 wchar_t *_GetItem(size_t nIndex, size_t *lpLength)
 {
-    if (nIndex < g_nCount)
+    if (nIndex < g_lpDb->nCount)
     {
+        const Index *lpIndex = &g_lpDb->IdxTab[nIndex];
         if (lpLength != NULL)
         {
-            *lpLength = g_IdxTab[nIndex].nLength;
+            *lpLength = _ItemLength(lpIndex);
         }
 
-        return g_IdxTab[nIndex].lpData;
+        TouchItem(nIndex);
+        if (lpIndex->bCompressed == true)
+        {
+            return FetchPinnedItem(lpIndex);
+        }
+        else
+        {
+            return _IndexData(lpIndex);
+        }
     }
     else
     {
@@ -51,6 +159,65 @@ const wchar_t *GetItem(size_t nIndex, size_t *lpLength)
     return _GetItem(nIndex, lpLength);
 }
 
+/*
+    Get the id of string
+*/
+size_t GetItemId(size_t nIndex)
+{
+    if (nIndex < g_lpDb->nCount)
+    {
+        return SlotItemId(g_lpDb->nSlotTab[nIndex]);
+    }
+    else
+    {
+        return SIZE_MAX;
+    }
+}
+
+/*
+    Get the current index of string by id
+*/
+size_t GetIndexById(size_t nId)
+{
+    size_t nSlot = nId & ((1u << SLOT_BITS) - 1);
+    if (nSlot < g_lpDb->nSlotCount && g_lpDb->nSlotIndex[nSlot] != INVALID_SLOT
+        && g_lpDb->nSlotGeneration[nSlot] == (nId >> SLOT_BITS))
+    {
+        return g_lpDb->nSlotIndex[nSlot];
+    }
+    else
+    {
+        return SIZE_MAX;
+    }
+}
+
+/*
+    Get the number of characters a string can occupy without moving
+*/
+size_t _GetItemCapacity(size_t nIndex)
+{
+    assert(nIndex < g_lpDb->nCount);
+
+    if (nIndex < g_lpDb->nSmallCount)
+    {
+        size_t nNextOffset = (nIndex + 1 < g_lpDb->nSmallCount) ?
+            g_lpDb->IdxTab[nIndex + 1].nOffset : STORAGE_SIZE;
+        return nNextOffset - g_lpDb->IdxTab[nIndex].nOffset;
+    }
+    else
+    {
+        // Own extents and free extents behind
+        size_t nFirst = (g_lpDb->IdxTab[nIndex].nOffset - STORAGE_SIZE) / EXTENT_SIZE;
+        size_t nLast = nFirst + (g_lpDb->IdxTab[nIndex].nLength + EXTENT_SIZE - 1) / EXTENT_SIZE;
+        while (nLast != EXTENT_COUNT && g_lpDb->bExtentUsed[nLast] == false)
+        {
+            ++nLast;
+        }
+
+        return nLast * EXTENT_SIZE + STORAGE_SIZE - g_lpDb->IdxTab[nIndex].nOffset;
+    }
+}
+
 /*
     Lookup request free size in storage
 */
@@ -65,33 +232,31 @@ wchar_t *LookupFreeSpace(size_t nMinSize, bool AllowDefrag, size_t *lpIndex)
     }
 
     // The beginning space of storage is free
-    if ((g_nUsedSize == 0) || 
-        (g_IdxTab[0].lpData != g_szStorage &&
-            g_IdxTab[0].lpData - g_szStorage >= nMinSize))
+    if ((g_lpDb->nUsedSize == 0) || (g_lpDb->IdxTab[0].nOffset >= nMinSize))
     {
         *lpIndex = 0;
-        return g_szStorage;
+        return g_lpDb->szStorage;
     }
     else
     {
         // Check string gap space
-        for (size_t i = 0; i != g_nCount - 1; ++i)
+        for (size_t i = 0; i != g_lpDb->nSmallCount - 1; ++i)
         {
-            wchar_t *lpPreEnd = g_IdxTab[i].lpData + g_IdxTab[i].nLength;
-            if (g_IdxTab[i + 1].lpData - lpPreEnd >= nMinSize)
+            size_t nPreEnd = g_lpDb->IdxTab[i].nOffset + g_lpDb->IdxTab[i].nLength;
+            if (g_lpDb->IdxTab[i + 1].nOffset - nPreEnd >= nMinSize)
             {
                 *lpIndex = i + 1;
-                return lpPreEnd;
+                return &g_lpDb->szStorage[nPreEnd];
             }
         }
 
         // Check last free space
-        wchar_t *lpLastEnd = g_IdxTab[g_nCount - 1].lpData + g_IdxTab[g_nCount - 1].nLength;
-        wchar_t *lpStorageEnd = &g_szStorage[STORAGE_SIZE];
-        if (lpStorageEnd - lpLastEnd >= nMinSize)
+        size_t nLastEnd = g_lpDb->IdxTab[g_lpDb->nSmallCount - 1].nOffset 
+            + g_lpDb->IdxTab[g_lpDb->nSmallCount - 1].nLength;
+        if (STORAGE_SIZE - nLastEnd >= nMinSize)
         {
-            *lpIndex = g_nCount;
-            return lpLastEnd;
+            *lpIndex = g_lpDb->nSmallCount;
+            return &g_lpDb->szStorage[nLastEnd];
         }
 
         // Too many fragments, no enough continuous space
@@ -108,6 +273,124 @@ wchar_t *LookupFreeSpace(size_t nMinSize, bool AllowDefrag, size_t *lpIndex)
     }
 }
 
+/*
+    Find continuous free extents in large storage
+*/
+size_t FindFreeExtents(size_t nExtentCount, size_t nSkipFirst, size_t nSkipCount)
+{
+    size_t nRun = 0;
+    for (size_t i = 0; i != EXTENT_COUNT; ++i)
+    {
+        if (g_lpDb->bExtentUsed[i] == false || (nSkipFirst <= i && i < nSkipFirst + nSkipCount))
+        {
+            if (++nRun == nExtentCount)
+            {
+                return i + 1 - nRun;
+            }
+        }
+        else
+        {
+            nRun = 0;
+        }
+    }
+
+    return EXTENT_COUNT;
+}
+
+/*
+    Lookup request free size in large storage
+*/
+wchar_t *LookupLargeSpace(size_t nMinSize, size_t *lpIndex)
+{
+    assert(lpIndex != NULL);
+
+    size_t nExtentCount = (nMinSize + EXTENT_SIZE - 1) / EXTENT_SIZE;
+    size_t nFirst = FindFreeExtents(nExtentCount, 0, 0);
+    if (nFirst == EXTENT_COUNT)
+    {
+        return NULL;
+    }
+
+    // Large strings are sorted by offset behind small strings
+    size_t nOffset = STORAGE_SIZE + nFirst * EXTENT_SIZE;
+    size_t nIndex = g_lpDb->nSmallCount;
+    while (nIndex != g_lpDb->nCount && g_lpDb->IdxTab[nIndex].nOffset < nOffset)
+    {
+        ++nIndex;
+    }
+
+    MarkExtents(nOffset, nMinSize, true);
+    *lpIndex = nIndex;
+    return &g_lpDb->szLargeStorage[nFirst * EXTENT_SIZE];
+}
+
+/*
+    Mark extents of a large string as used or free
+*/
+void MarkExtents(size_t nOffset, size_t nLength, bool bUsed)
+{
+    assert(nOffset >= STORAGE_SIZE);
+
+    size_t nFirst = (nOffset - STORAGE_SIZE) / EXTENT_SIZE;
+    size_t nExtentCount = (nLength + EXTENT_SIZE - 1) / EXTENT_SIZE;
+    for (size_t i = nFirst; i != nFirst + nExtentCount; ++i)
+    {
+        assert(g_lpDb->bExtentUsed[i] != bUsed);
+        g_lpDb->bExtentUsed[i] = bUsed;
+    }
+
+    if (bUsed == true)
+    {
+        g_lpDb->nUsedExtents += nExtentCount;
+    }
+    else
+    {
+        g_lpDb->nUsedExtents -= nExtentCount;
+    }
+}
+
+/*
+    Check whether a string can be stored after another string is released
+*/
+bool CanStoreAfterRelease(size_t nLength, size_t nReleaseIndex)
+{
+    assert(nReleaseIndex < g_lpDb->nCount);
+
+    const Index *lpRelease = &g_lpDb->IdxTab[nReleaseIndex];
+    if (nLength > g_lpDb->nLargeThreshold)
+    {
+        size_t nSkipFirst = 0, nSkipCount = 0;
+        if (nReleaseIndex >= g_lpDb->nSmallCount)
+        {
+            nSkipFirst = (lpRelease->nOffset - STORAGE_SIZE) / EXTENT_SIZE;
+            nSkipCount = (lpRelease->nLength + EXTENT_SIZE - 1) / EXTENT_SIZE;
+        }
+
+        size_t nExtentCount = (nLength + EXTENT_SIZE - 1) / EXTENT_SIZE;
+        return FindFreeExtents(nExtentCount, nSkipFirst, nSkipCount) != EXTENT_COUNT;
+    }
+    else
+    {
+        // Small storage is defragged when necessary, only the total size matters
+        size_t nFreeSize = GetFreeSize();
+        if (nReleaseIndex < g_lpDb->nSmallCount)
+        {
+            nFreeSize += lpRelease->nLength;
+        }
+
+        return nLength <= nFreeSize;
+    }
+}
+
+/*
+    Set the threshold of large strings
+*/
+void SetLargeStringThreshold(size_t nThreshold)
+{
+    // Strings not longer than threshold must fit small storage
+    g_lpDb->nLargeThreshold = (nThreshold < STORAGE_SIZE) ? nThreshold : STORAGE_SIZE;
+}
+
 /*
     Store string to database
 */
@@ -115,21 +398,33 @@ bool Store(const wchar_t *lpString, size_t *lpIndex)
 {
     assert(lpString != NULL);
 
+    // Index table is full, empty strings can take no storage
+    if (g_lpDb->nCount == MAX_STRING_COUNT)
+    {
+        return false;
+    }
+
     size_t nIndex = 0;
     size_t nLength = wcslen(lpString) + 1;
-    wchar_t *lpBuffer = LookupFreeSpace(nLength, true, &nIndex);
+    bool bLarge = (nLength > g_lpDb->nLargeThreshold);
+    wchar_t *lpBuffer = (bLarge == true) ? 
+        LookupLargeSpace(nLength, &nIndex) : LookupFreeSpace(nLength, true, &nIndex);
     if (lpBuffer != NULL)
     {
-        memset(lpBuffer, '\0', nLength * sizeof(wchar_t));
-        wcscpy(lpBuffer, lpString);
-        InsertIndex(nIndex, lpBuffer);
+        // Copy with '\0' at once
+        memcpy(lpBuffer, lpString, nLength * sizeof(wchar_t));
+        InsertIndex(nIndex, lpBuffer, nLength);
         if (lpIndex != NULL)
         {
             *lpIndex = nIndex;
         }
 
-        g_nUsedSize += nLength;
-        ++g_nCount;
+        if (bLarge == false)
+        {
+            g_lpDb->nUsedSize += nLength;
+        }
+
+        ++g_lpDb->nCount;
         return true;
     }
     else
@@ -143,361 +438,1801 @@ bool Store(const wchar_t *lpString, size_t *lpIndex)
 */
 void ClearQueryRecords()
 {
-    memset(g_QueryRecords, 0, sizeof(g_QueryRecords));
+    memset(g_lpDb->QueryRecords, 0, sizeof(g_lpDb->QueryRecords));
 }
 
 /*
-    Query string by index
+    Point query records to their strings by indexes
 */
-wchar_t *_QueryByIndex(size_t nIndex, size_t *lpLength)
+void ResolveRecords(size_t nMatchCount)
 {
-    return _GetItem(nIndex, lpLength);
+    for (size_t i = 0; i != nMatchCount; ++i)
+    {
+        const Index *lpIndex = &g_lpDb->IdxTab[g_lpDb->QueryRecords[i].nIndex];
+        if (lpIndex->bCompressed == true)
+        {
+            g_lpDb->QueryRecords[i].lpData = FetchPinnedItem(lpIndex);
+        }
+        else
+        {
+            g_lpDb->QueryRecords[i].lpData = _IndexData(lpIndex);
+        }
+    }
 }
 
-const wchar_t *QueryByIndex(size_t nIndex, size_t *lpLength)
+/*
+    Change database version
+*/
+void UpdateVersion()
 {
-    return _QueryByIndex(nIndex, lpLength);
+    ++g_lpDb->nVersion;
+}
+
+/*
+    Publish a change event to change ring
+*/
+void PublishChange(const ChangeEvent *lpChange, const wchar_t *lpString)
+{
+    assert(lpChange != NULL);
+
+    if (g_lpDb->bChangesPaused == true)
+    {
+        // Strings relocated meanwhile are published after the change
+        if (lpChange->nType == CHANGE_RELOCATE && lpChange->nIndex < g_lpDb->nPausedRelocate)
+        {
+            g_lpDb->nPausedRelocate = lpChange->nIndex;
+        }
+
+        return;
+    }
+
+    // Only the writer changes head, so it is read without ordering
+    int nType = lpChange->nType;
+    size_t nIndex = lpChange->nIndex, nLength = lpChange->nLength;
+    size_t nSequence = g_lpDb->nChangeHead + 1;
+    ChangeSlot *lpSlot = &g_lpDb->ChangeRing[nSequence & (CHANGE_RING_SIZE - 1)];
+    STORE_RELEASE(&lpSlot->nLock, nSequence * 2 - 1);
+    MEMORY_FENCE();
+
+    ChangeEvent Event = *lpChange;
+    Event.nSequence = nSequence;
+    Event.nOffset = (nType == CHANGE_DELETE || nType == CHANGE_CLEAR) ?
+        0 : g_lpDb->IdxTab[nIndex].nOffset;
+    Event.nDataPosition = g_lpDb->nArenaHead;
+    CopyEvent(&lpSlot->Event, &Event);
+    if (lpString != NULL)
+    {
+        // Move head before writing, so readers can tell overwritten strings
+        size_t nPosition = g_lpDb->nArenaHead, nDataLength = nLength - 1;
+        STORE_RELEASE(&g_lpDb->nArenaHead, nPosition + nDataLength);
+        MEMORY_FENCE();
+
+        size_t nOffset = nPosition & (CHANGE_ARENA_SIZE - 1);
+        size_t nFirstPart = (nDataLength < CHANGE_ARENA_SIZE - nOffset) ?
+            nDataLength : CHANGE_ARENA_SIZE - nOffset;
+        CopyArenaChars(&g_lpDb->szChangeArena[nOffset], lpString, nFirstPart);
+        CopyArenaChars(g_lpDb->szChangeArena, &lpString[nFirstPart], nDataLength - nFirstPart);
+    }
+
+    STORE_RELEASE(&lpSlot->nLock, nSequence * 2);
+    STORE_RELEASE(&g_lpDb->nChangeHead, nSequence);
+}
+
+/*
+    Copy an event field by field with relaxed atomic accesses
+*/
+void CopyEvent(ChangeEvent *lpDest, const ChangeEvent *lpSource)
+{
+    STORE_RELAXED(size_t, &lpDest->nSequence, LOAD_RELAXED(size_t, &lpSource->nSequence));
+    STORE_RELAXED(int, &lpDest->nType, LOAD_RELAXED(int, &lpSource->nType));
+    STORE_RELAXED(size_t, &lpDest->nIndex, LOAD_RELAXED(size_t, &lpSource->nIndex));
+    STORE_RELAXED(size_t, &lpDest->nId, LOAD_RELAXED(size_t, &lpSource->nId));
+    STORE_RELAXED(size_t, &lpDest->nPreviousIndex, LOAD_RELAXED(size_t, &lpSource->nPreviousIndex));
+    STORE_RELAXED(size_t, &lpDest->nPreviousId, LOAD_RELAXED(size_t, &lpSource->nPreviousId));
+    STORE_RELAXED(size_t, &lpDest->nOffset, LOAD_RELAXED(size_t, &lpSource->nOffset));
+    STORE_RELAXED(size_t, &lpDest->nLength, LOAD_RELAXED(size_t, &lpSource->nLength));
+    STORE_RELAXED(size_t, &lpDest->nDataPosition, LOAD_RELAXED(size_t, &lpSource->nDataPosition));
+}
+
+/*
+    Copy characters to or from change arena with relaxed atomic accesses
+*/
+void CopyArenaChars(wchar_t *lpDest, const wchar_t *lpSource, size_t nLength)
+{
+    for (size_t i = 0; i != nLength; ++i)
+    {
+        STORE_RELAXED(wchar_t, &lpDest[i], LOAD_RELAXED(wchar_t, &lpSource[i]));
+    }
+}
+
+/*
+    Read the whole string stored or altered by a change event
+*/
+bool ReadChangeData(const ChangeEvent *lpEvent, wchar_t *lpBuffer)
+{
+    assert(lpEvent != NULL);
+    assert(lpBuffer != NULL);
+
+    if (lpEvent->nType != CHANGE_STORE && lpEvent->nType != CHANGE_ALTER)
+    {
+        return false;
+    }
+
+    // Copy first, then check the arena is not rewritten meanwhile
+    size_t nDataLength = lpEvent->nLength - 1;
+    size_t nOffset = lpEvent->nDataPosition & (CHANGE_ARENA_SIZE - 1);
+    size_t nFirstPart = (nDataLength < CHANGE_ARENA_SIZE - nOffset) ?
+        nDataLength : CHANGE_ARENA_SIZE - nOffset;
+    CopyArenaChars(lpBuffer, &g_lpDb->szChangeArena[nOffset], nFirstPart);
+    CopyArenaChars(&lpBuffer[nFirstPart], g_lpDb->szChangeArena, nDataLength - nFirstPart);
+    lpBuffer[nDataLength] = L'\0';
+    MEMORY_FENCE();
+
+    return LOAD_ACQUIRE(&g_lpDb->nArenaHead) - lpEvent->nDataPosition <= CHANGE_ARENA_SIZE;
+}
+
+/*
+    Get sequence number of the latest change event
+*/
+size_t GetChangeSequence()
+{
+    return LOAD_ACQUIRE(&g_lpDb->nChangeHead);
+}
+
+/*
+    Copy all strings with their ids and the sequence of the latest change
+*/
+Snapshot *TakeSnapshot()
+{
+    // Snapshot, ids, string pointers and strings are allocated at once
+    size_t nCount = g_lpDb->nCount, nChars = 0;
+    for (size_t i = 0; i != nCount; ++i)
+    {
+        nChars += _ItemLength(&g_lpDb->IdxTab[i]);
+    }
+
+    Snapshot *lpSnapshot = malloc(sizeof(Snapshot) + nCount * sizeof(size_t)
+        + nCount * sizeof(wchar_t *) + nChars * sizeof(wchar_t));
+    if (lpSnapshot == NULL)
+    {
+        return NULL;
+    }
+
+    lpSnapshot->nSequence = g_lpDb->nChangeHead;
+    lpSnapshot->nCount = nCount;
+    lpSnapshot->lpIds = (size_t *)(lpSnapshot + 1);
+    lpSnapshot->lpStrings = (const wchar_t **)(lpSnapshot->lpIds + nCount);
+    wchar_t *lpNext = (wchar_t *)(lpSnapshot->lpStrings + nCount);
+    for (size_t i = 0; i != nCount; ++i)
+    {
+        const Index *lpIndex = &g_lpDb->IdxTab[i];
+        if (lpIndex->bCompressed == true)
+        {
+            DecodeItem(lpIndex, lpNext);
+        }
+        else
+        {
+            wmemcpy(lpNext, _IndexData(lpIndex), lpIndex->nLength);
+        }
+
+        lpSnapshot->lpIds[i] = GetItemId(i);
+        lpSnapshot->lpStrings[i] = lpNext;
+        lpNext += _ItemLength(lpIndex);
+    }
+
+    return lpSnapshot;
+}
+
+/*
+    Free a snapshot taken by TakeSnapshot
+*/
+void FreeSnapshot(Snapshot *lpSnapshot)
+{
+    free(lpSnapshot);
 }
 
-/*
-    Query next matched string by content
-*/
-wchar_t *_QueryNextByContent(const wchar_t *lpString,
-    size_t nBeginIndex, size_t *lpMatchIndex)
-{
-    assert(lpString != NULL);
-    assert(nBeginIndex <= g_nCount);
+/*
+    Read change events after a cursor
+*/
+size_t ReadChanges(size_t nCursor, ChangeEvent *lpEvents, size_t nMaxCount)
+{
+    assert(lpEvents != NULL || nMaxCount == 0);
+
+    size_t nHead = LOAD_ACQUIRE(&g_lpDb->nChangeHead);
+    if (nCursor > nHead)
+    {
+        return 0;
+    }
+    else if (nHead - nCursor > CHANGE_RING_SIZE)
+    {
+        return CHANGE_CURSOR_LOST;
+    }
+
+    size_t nCount = 0;
+    for (size_t nSequence = nCursor + 1; nSequence <= nHead && nCount != nMaxCount; ++nSequence)
+    {
+        // Copy first, then check the slot is not rewritten meanwhile
+        const ChangeSlot *lpSlot = &g_lpDb->ChangeRing[nSequence & (CHANGE_RING_SIZE - 1)];
+        size_t nLock = LOAD_ACQUIRE(&lpSlot->nLock);
+        CopyEvent(&lpEvents[nCount], &lpSlot->Event);
+        MEMORY_FENCE();
+        if (nLock != nSequence * 2 || LOAD_ACQUIRE(&lpSlot->nLock) != nLock)
+        {
+            // Overwritten by newer events, the events read are still valid
+            return (nCount != 0) ? nCount : CHANGE_CURSOR_LOST;
+        }
+
+        ++nCount;
+    }
+
+    return nCount;
+}
+
+/*
+    Get database version
+*/
+size_t GetDatabaseVersion()
+{
+    return g_lpDb->nVersion;
+}
+
+/*
+    Get memory used by cached query results
+*/
+size_t GetQueryCacheMemory()
+{
+    return g_lpDb->nQueryCacheMemory;
+}
+
+/*
+    Lookup cached query result
+*/
+bool LookupQueryCache(int nType, int nMode,
+    const wchar_t *lpString, size_t *lpMatchCount)
+{
+    assert(lpString != NULL);
+    assert(lpMatchCount != NULL);
+
+    for (size_t i = 0; i != QUERY_CACHE_COUNT; ++i)
+    {
+        QueryCacheEntry *lpEntry = &g_lpDb->QueryCache[i];
+        if (lpEntry->nTouch == 0 || lpEntry->nType != nType || lpEntry->nMode != nMode
+            || wcscmp(lpEntry->lpKey, lpString) != 0)
+        {
+            continue;
+        }
+        else if (lpEntry->nVersion != g_lpDb->nVersion)
+        {
+            // Outdated, never be valid again
+            DropQueryCache(lpEntry);
+            return false;
+        }
+
+        // Matched strings are touched as if they are queried again
+        for (size_t j = 0; j != lpEntry->nMatchCount; ++j)
+        {
+            g_lpDb->QueryRecords[j].nIndex = lpEntry->lpIndexes[j];
+            TouchItem(lpEntry->lpIndexes[j]);
+        }
+
+        ResolveRecords(lpEntry->nMatchCount);
+
+        lpEntry->nTouch = ++g_lpDb->nQueryCacheClock;
+        *lpMatchCount = lpEntry->nMatchCount;
+        return true;
+    }
+
+    return false;
+}
+
+/*
+    Cache query result in query records
+*/
+void SaveQueryCache(int nType, int nMode, const wchar_t *lpString, size_t nMatchCount)
+{
+    assert(lpString != NULL);
+
+    size_t nKeySize = (wcslen(lpString) + 1) * sizeof(wchar_t);
+    size_t nMemory = nMatchCount * sizeof(uint32_t) + nKeySize;
+    if (nMemory > QUERY_CACHE_MEMORY)
+    {
+        return;
+    }
+
+    // Drop outdated results first, then the least recently used ones,
+    // until there is a free entry and enough memory
+    QueryCacheEntry *lpFree = NULL;
+    for (size_t i = 0; i != QUERY_CACHE_COUNT; ++i)
+    {
+        if (g_lpDb->QueryCache[i].nTouch != 0 && g_lpDb->QueryCache[i].nVersion != g_lpDb->nVersion)
+        {
+            DropQueryCache(&g_lpDb->QueryCache[i]);
+        }
+    }
+
+    while (true)
+    {
+        QueryCacheEntry *lpVictim = NULL;
+        lpFree = NULL;
+        for (size_t i = 0; i != QUERY_CACHE_COUNT; ++i)
+        {
+            QueryCacheEntry *lpEntry = &g_lpDb->QueryCache[i];
+            if (lpEntry->nTouch == 0)
+            {
+                lpFree = lpEntry;
+            }
+            else if (lpVictim == NULL || lpEntry->nTouch < lpVictim->nTouch)
+            {
+                lpVictim = lpEntry;
+            }
+        }
+
+        if (lpFree != NULL && g_lpDb->nQueryCacheMemory + nMemory <= QUERY_CACHE_MEMORY)
+        {
+            break;
+        }
+
+        assert(lpVictim != NULL);
+        DropQueryCache(lpVictim);
+    }
+
+    uint32_t *lpIndexes = malloc(nMemory);
+    if (lpIndexes == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i != nMatchCount; ++i)
+    {
+        lpIndexes[i] = (uint32_t)g_lpDb->QueryRecords[i].nIndex;
+    }
+
+    wchar_t *lpKey = (wchar_t *)&lpIndexes[nMatchCount];
+    memcpy(lpKey, lpString, nKeySize);
+
+    lpFree->nType = nType;
+    lpFree->nMode = nMode;
+    lpFree->nVersion = g_lpDb->nVersion;
+    lpFree->lpKey = lpKey;
+    lpFree->lpIndexes = lpIndexes;
+    lpFree->nMatchCount = nMatchCount;
+    lpFree->nMemory = nMemory;
+    lpFree->nTouch = ++g_lpDb->nQueryCacheClock;
+    g_lpDb->nQueryCacheMemory += nMemory;
+}
+
+/*
+    Drop a cached query result
+*/
+void DropQueryCache(QueryCacheEntry *lpEntry)
+{
+    assert(lpEntry != NULL);
+
+    if (lpEntry->nTouch != 0)
+    {
+        free(lpEntry->lpIndexes);
+        g_lpDb->nQueryCacheMemory -= lpEntry->nMemory;
+        memset(lpEntry, 0, sizeof(QueryCacheEntry));
+    }
+}
+
+/*
+    Query string by index
+*/
+wchar_t *_QueryByIndex(size_t nIndex, size_t *lpLength)
+{
+    return _GetItem(nIndex, lpLength);
+}
+
+const wchar_t *QueryByIndex(size_t nIndex, size_t *lpLength)
+{
+    return _QueryByIndex(nIndex, lpLength);
+}
+
+/*
+    Query next matched string by content
+*/
+wchar_t *_QueryNextByContent(const wchar_t *lpString, 
+    int nMode, size_t nBeginIndex, size_t *lpMatchIndex)
+{
+    assert(lpString != NULL);
+    assert(nBeginIndex <= g_lpDb->nCount);
+    assert(nMode >= QUERY_MODE_EXACT && nMode <= QUERY_MODE_NORMALIZED);
+
+    if (nMode != QUERY_MODE_EXACT)
+    {
+        return _QueryNextByFoldedKey(lpString, 
+            nMode == QUERY_MODE_NORMALIZED, nBeginIndex, lpMatchIndex);
+    }
+
+    size_t nLength = wcslen(lpString) + 1;
+    size_t nCodeSize = 0;
+    bool bEncoded = false;
+    for (size_t i = nBeginIndex; i < g_lpDb->nCount; ++i)
+    {
+        const Index *lpIndex = &g_lpDb->IdxTab[i];
+        bool bMatched = false;
+        if (lpIndex->bCompressed == false)
+        {
+            bMatched = (lpIndex->nLength == nLength
+                && wcscmp(lpString, _IndexData(lpIndex)) == 0);
+        }
+        else if (_ItemLength(lpIndex) == nLength)
+        {
+            // Encoding is deterministic, so compare codes without decompressing
+            if (bEncoded == false)
+            {
+                nCodeSize = EncodeString(&g_lpDb->Dictionary, lpString,
+                    nLength - 1, g_lpDb->QueryCode, sizeof(g_lpDb->QueryCode));
+                bEncoded = true;
+            }
+
+            const wchar_t *lpData = _IndexData(lpIndex);
+            bMatched = (nCodeSize == (size_t)lpData[1]
+                && memcmp(&lpData[COMPRESSED_HEADER_SIZE], g_lpDb->QueryCode, nCodeSize) == 0);
+        }
+
+        if (bMatched == true)
+        {
+            if (lpMatchIndex != NULL)
+            {
+                *lpMatchIndex = i;
+            }
+
+            TouchItem(i);
+            if (lpIndex->bCompressed == true)
+            {
+                return FetchPinnedItem(lpIndex);
+            }
+            else
+            {
+                return _IndexData(lpIndex);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+const wchar_t *QueryNextByContent(
+    const wchar_t *lpString, size_t nBeginIndex, size_t *lpMatchIndex)
+{
+    return _QueryNextByContent(lpString, QUERY_MODE_EXACT, nBeginIndex, lpMatchIndex);
+}
+
+const wchar_t *QueryNextByContentEx(const wchar_t *lpString,
+    int nMode, size_t nBeginIndex, size_t *lpMatchIndex)
+{
+    return _QueryNextByContent(lpString, nMode, nBeginIndex, lpMatchIndex);
+}
+
+/*
+    Query next string which is equal to string after folding
+*/
+wchar_t *_QueryNextByFoldedKey(const wchar_t *lpString,
+    bool bNormalize, size_t nBeginIndex, size_t *lpMatchIndex)
+{
+    assert(lpString != NULL);
+    assert(nBeginIndex <= g_lpDb->nCount);
+
+    // No stored string is so long, and it would overflow folding buffer
+    size_t nLength = wcslen(lpString);
+    if (nLength >= MAX_STRING_LENGTH)
+    {
+        return NULL;
+    }
+
+    uint32_t nKey = HashFoldedString(lpString, nLength, bNormalize);
+    const uint32_t *lpKeyTab = (bNormalize == true) ? g_lpDb->nNormKeyTab : g_lpDb->nCaseKeyTab;
+    size_t nKeyLength = 0;
+    bool bFolded = false;
+    for (size_t i = nBeginIndex; i < g_lpDb->nCount; ++i)
+    {
+        if (lpKeyTab[i] != nKey)
+        {
+            continue;
+        }
+
+        // Keys may collide, compare folded strings
+        if (bFolded == false)
+        {
+            nKeyLength = FoldString(lpString, nLength, bNormalize, g_lpDb->szFoldQuery);
+            bFolded = true;
+        }
+
+        const Index *lpIndex = &g_lpDb->IdxTab[i];
+        if (FoldItem(lpIndex, bNormalize, g_lpDb->szFoldBuffer) == nKeyLength
+            && memcmp(g_lpDb->szFoldBuffer, g_lpDb->szFoldQuery, nKeyLength * sizeof(wchar_t)) == 0)
+        {
+            if (lpMatchIndex != NULL)
+            {
+                *lpMatchIndex = i;
+            }
+
+            TouchItem(i);
+            if (lpIndex->bCompressed == true)
+            {
+                return FetchPinnedItem(lpIndex);
+            }
+            else
+            {
+                return _IndexData(lpIndex);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/*
+    Query all strings by content
+*/
+const QueryRecord *QueryAllByContent(const wchar_t *lpString, size_t *lpMatchCount)
+{
+    return QueryAllByContentEx(lpString, QUERY_MODE_EXACT, lpMatchCount);
+}
+
+/*
+    Query all strings by content in a query mode
+*/
+const QueryRecord *QueryAllByContentEx(const wchar_t *lpString,
+    int nMode, size_t *lpMatchCount)
+{
+    assert(lpString != NULL);
+    assert(lpMatchCount != NULL);
+
+    ClearQueryRecords();
+    if (LookupQueryCache(QUERY_TYPE_ALL, nMode, lpString, lpMatchCount) == true)
+    {
+        return g_lpDb->QueryRecords;
+    }
+
+    size_t nMatchCount = 0, nMatchIndex = 0;
+    wchar_t *lpResult = _QueryNextByContent(lpString, nMode, nMatchIndex, &nMatchIndex);
+    while (lpResult != NULL)
+    {
+        g_lpDb->QueryRecords[nMatchCount].lpData = lpResult;
+        g_lpDb->QueryRecords[nMatchCount].nIndex = nMatchIndex;
+        ++nMatchCount;
+
+        lpResult = _QueryNextByContent(lpString, nMode, nMatchIndex + 1, &nMatchIndex);
+    }
+
+    ResolveRecords(nMatchCount);
+    SaveQueryCache(QUERY_TYPE_ALL, nMode, lpString, nMatchCount);
+    *lpMatchCount = nMatchCount;
+    return g_lpDb->QueryRecords;
+}
+
+/*
+    Fuzzy query all strings by content
+*/
+const QueryRecord *FuzzyQueryAllByContent(const wchar_t *lpString, size_t *lpMatchCount)
+{
+    return FuzzyQueryAllByContentEx(lpString, QUERY_MODE_EXACT, lpMatchCount);
+}
+
+/*
+    Fuzzy query all strings by content in a query mode
+*/
+const QueryRecord *FuzzyQueryAllByContentEx(const wchar_t *lpString,
+    int nMode, size_t *lpMatchCount)
+{
+    assert(lpString != NULL);
+    assert(lpMatchCount != NULL);
+    assert(nMode >= QUERY_MODE_EXACT && nMode <= QUERY_MODE_NORMALIZED);
+
+    ClearQueryRecords();
+    if (LookupQueryCache(QUERY_TYPE_FUZZY, nMode, lpString, lpMatchCount) == true)
+    {
+        return g_lpDb->QueryRecords;
+    }
+
+    // Substrings can not be found by keys, fold string and each stored
+    // string to search in folded strings
+    bool bNormalize = (nMode == QUERY_MODE_NORMALIZED);
+    const wchar_t *lpKey = lpString;
+    size_t nLength = wcslen(lpString);
+    if (nLength >= MAX_STRING_LENGTH)
+    {
+        // No stored string can contain it, and it would overflow folding buffer
+        *lpMatchCount = 0;
+        return g_lpDb->QueryRecords;
+    }
+    else if (nMode != QUERY_MODE_EXACT)
+    {
+        size_t nKeyLength = FoldString(lpString, nLength, bNormalize, g_lpDb->szFoldQuery);
+        g_lpDb->szFoldQuery[nKeyLength] = L'\0';
+        lpKey = g_lpDb->szFoldQuery;
+    }
+
+    // Compressed strings are searched in their codes, unless the key is
+    // too long for a matcher or strings are folded
+    bool bMatchCodes = (nMode == QUERY_MODE_EXACT && g_lpDb->nCompressedCount != 0
+        && InitCodeMatcher(&g_lpDb->Matcher, &g_lpDb->Dictionary, lpKey, nLength) == true);
+
+    size_t nMatchCount = 0;
+    for (size_t i = 0; i != g_lpDb->nCount; ++i)
+    {
+        const Index *lpIndex = &g_lpDb->IdxTab[i];
+        wchar_t *lpData = _IndexData(lpIndex);
+        bool bMatched = false;
+        if (nMode != QUERY_MODE_EXACT)
+        {
+            FoldItem(lpIndex, bNormalize, g_lpDb->szFoldBuffer);
+            bMatched = (wcsstr(g_lpDb->szFoldBuffer, lpKey) != NULL);
+        }
+        else if (lpIndex->bCompressed == false)
+        {
+            bMatched = (wcsstr(lpData, lpKey) != NULL);
+        }
+        else if (bMatchCodes == true)
+        {
+            bMatched = MatchCodes(&g_lpDb->Matcher,
+                (const uint8_t *)&lpData[COMPRESSED_HEADER_SIZE], (size_t)lpData[1]);
+        }
+        else
+        {
+            DecodeItem(lpIndex, g_lpDb->szThawBuffer);
+            bMatched = (wcsstr(g_lpDb->szThawBuffer, lpKey) != NULL);
+        }
+
+        if (bMatched == true)
+        {
+            g_lpDb->QueryRecords[nMatchCount].nIndex = i;
+            ++nMatchCount;
+            TouchItem(i);
+        }
+    }
+
+    ResolveRecords(nMatchCount);
+    SaveQueryCache(QUERY_TYPE_FUZZY, nMode, lpString, nMatchCount);
+    *lpMatchCount = nMatchCount;
+    return g_lpDb->QueryRecords;
+}
+
+/*
+    Delete string by index
+*/
+bool DeleteByIndex(size_t nIndex)
+{
+    if (nIndex < g_lpDb->nCount)
+    {
+        // Release the occupied size, compressed or not
+        Index *lpIndex = &g_lpDb->IdxTab[nIndex];
+        size_t nLength = lpIndex->nLength;
+        RemoveItemFromSketches(lpIndex);
+        memset(_IndexData(lpIndex), '\0', nLength * sizeof(wchar_t));
+        if (lpIndex->bCompressed == true)
+        {
+            --g_lpDb->nCompressedCount;
+        }
+
+        if (nIndex < g_lpDb->nSmallCount)
+        {
+            g_lpDb->nUsedSize -= nLength;
+        }
+        else
+        {
+            MarkExtents(g_lpDb->IdxTab[nIndex].nOffset, nLength, false);
+        }
+
+        DeleteIndex(nIndex);
+        --g_lpDb->nCount;
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+/*
+    Delete next matched string by content
+*/
+bool DeleteNextByContent(const wchar_t *lpString, 
+    size_t nBeginIndex, size_t *lpDeleteIndex)
+{
+    assert(lpString != NULL);
+    assert(nBeginIndex <= g_lpDb->nCount);
+
+    size_t nDeleteIndex = 0;
+    if (QueryNextByContent(lpString, nBeginIndex, &nDeleteIndex) != NULL)
+    {
+        DeleteByIndex(nDeleteIndex);
+        if (lpDeleteIndex != NULL)
+        {
+            *lpDeleteIndex = nDeleteIndex;
+        }
+
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+/*
+    Delete all matched string by content
+*/
+size_t DeleteAllByContent(const wchar_t *lpString)
+{
+    assert(lpString != NULL);
+
+    size_t nDeleteCount = 0, nDeleteIndex = 0;
+    bool bResult = DeleteNextByContent(lpString, nDeleteIndex, &nDeleteIndex);
+    while (bResult != false)
+    {
+        ++nDeleteCount;
+        bResult = DeleteNextByContent(lpString, nDeleteIndex, &nDeleteIndex);
+    }
+
+    return nDeleteCount;
+}
+
+/*
+    Alter string by index
+*/
+bool AlterByIndex(size_t nIndex, const wchar_t *lpNewString, size_t *lpNewIndex)
+{
+    assert(lpNewString != NULL);
+
+    if (nIndex < g_lpDb->nCount)
+    {
+        // Replace the whole string
+        size_t nSrcLength = _ItemLength(&g_lpDb->IdxTab[nIndex]);
+        return SpliceItem(nIndex, 0, nSrcLength - 1, lpNewString, lpNewIndex);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+/*
+    Replace a range of string with another string
+*/
+bool SpliceItem(size_t nIndex, size_t nOffset, size_t nEraseCount,
+    const wchar_t *lpString, size_t *lpNewIndex)
+{
+    assert(lpString != NULL);
+
+    if (nIndex >= g_lpDb->nCount)
+    {
+        return false;
+    }
+
+    Index *lpIndex = &g_lpDb->IdxTab[nIndex];
+    size_t nSrcSize = lpIndex->nLength;     // Occupied size in storage
+    size_t nSrcLength = _ItemLength(lpIndex);
+    if (nOffset > nSrcLength - 1 || nEraseCount > nSrcLength - 1 - nOffset)
+    {
+        return false;
+    }
+
+    // Compressed string is decompressed to be spliced, and stored uncompressed
+    wchar_t *lpSrcString = _IndexData(lpIndex);
+    wchar_t *lpSource = lpSrcString;
+    if (lpIndex->bCompressed == true)
+    {
+        DecodeItem(lpIndex, g_lpDb->szThawBuffer);
+        lpSource = g_lpDb->szThawBuffer;
+    }
+
+    size_t nInsertCount = wcslen(lpString);
+    size_t nNewLength = nSrcLength - nEraseCount + nInsertCount;
+    wchar_t *lpTail = lpSource + nOffset + nEraseCount;
+    size_t nTailCount = nSrcLength - nOffset - nEraseCount;   // Including '\0'
+    bool bFitted = (nNewLength <= _GetItemCapacity(nIndex));
+
+    // The inserted string may be a string in storage, which would be
+    // overwritten by shifting the tail
+    bool bAliased = (g_lpDb->szStorage <= lpString && lpString < &g_lpDb->szStorage[STORAGE_SIZE])
+        || (g_lpDb->szLargeStorage <= lpString 
+            && lpString < &g_lpDb->szLargeStorage[LARGE_STORAGE_SIZE]);
+
+    if (bFitted == true && bAliased == false && lpSource == lpSrcString)
+    {
+        // Alter on the same place, only move the tail and copy new part
+        RemoveItemFromSketches(lpIndex);
+        memmove(lpSrcString + nOffset + nInsertCount, lpTail, nTailCount * sizeof(wchar_t));
+        memcpy(lpSrcString + nOffset, lpString, nInsertCount * sizeof(wchar_t));
+    }
+    else if (bFitted == true || CanStoreAfterRelease(nNewLength, nIndex) == true)
+    {
+        memcpy(g_lpDb->szSpliceBuffer, lpSource, nOffset * sizeof(wchar_t));
+        memcpy(g_lpDb->szSpliceBuffer + nOffset, lpString, nInsertCount * sizeof(wchar_t));
+        memcpy(g_lpDb->szSpliceBuffer + nOffset + nInsertCount, 
+            lpTail, nTailCount * sizeof(wchar_t));
+        if (bFitted == true)
+        {
+            RemoveItemFromSketches(lpIndex);
+            memcpy(lpSrcString, g_lpDb->szSpliceBuffer, nNewLength * sizeof(wchar_t));
+        }
+        else
+        {
+            // No enough space behind, delete source and find a new place to
+            // store, which is published as one change
+            size_t nPreviousId = GetItemId(nIndex), nStoredIndex = 0;
+            g_lpDb->bChangesPaused = true;
+            g_lpDb->nPausedRelocate = SIZE_MAX;
+            DeleteByIndex(nIndex);
+            bool bStored = Store(g_lpDb->szSpliceBuffer, &nStoredIndex);
+            g_lpDb->bChangesPaused = false;
+
+            ChangeEvent Change = { .nType = CHANGE_ALTER, .nIndex = nStoredIndex,
+                .nId = GetItemId(nStoredIndex), .nPreviousIndex = nIndex,
+                .nPreviousId = nPreviousId, .nLength = nNewLength };
+            if (bStored == false)
+            {
+                Change.nType = CHANGE_DELETE;
+                Change.nIndex = nIndex;
+                Change.nId = nPreviousId;
+                Change.nLength = 0;
+            }
+
+            PublishChange(&Change, (bStored == true) ? g_lpDb->szSpliceBuffer : NULL);
+            if (g_lpDb->nPausedRelocate != SIZE_MAX)
+            {
+                // Defragged to store, strings from the stored one may be shifted too
+                size_t nFirstMoved = g_lpDb->nPausedRelocate;
+                if (bStored == true && nStoredIndex < nFirstMoved)
+                {
+                    nFirstMoved = nStoredIndex;
+                }
+
+                ChangeEvent Relocate = { .nType = CHANGE_RELOCATE, .nIndex = nFirstMoved,
+                    .nId = SIZE_MAX, .nPreviousIndex = nFirstMoved, .nPreviousId = SIZE_MAX,
+                    .nLength = g_lpDb->nSmallCount - nFirstMoved };
+                PublishChange(&Relocate, NULL);
+            }
+
+            if (bStored == true && lpNewIndex != NULL)
+            {
+                *lpNewIndex = nStoredIndex;
+            }
+
+            return bStored;
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    if (nNewLength < nSrcSize)
+    {
+        // Clear the released space
+        memset(lpSrcString + nNewLength, '\0', (nSrcSize - nNewLength) * sizeof(wchar_t));
+    }
+
+    if (nIndex < g_lpDb->nSmallCount)
+    {
+        g_lpDb->nUsedSize = g_lpDb->nUsedSize - nSrcSize + nNewLength;
+    }
+    else
+    {
+        MarkExtents(lpIndex->nOffset, nSrcSize, false);
+        MarkExtents(lpIndex->nOffset, nNewLength, true);
+    }
+
+    if (lpIndex->bCompressed == true)
+    {
+        lpIndex->bCompressed = false;
+        --g_lpDb->nCompressedCount;
+    }
+
+    lpIndex->nLength = (uint32_t)nNewLength;
+    SetFoldKeys(nIndex, lpSrcString, nNewLength);
+    AddToSketches(&g_lpDb->Sketches, lpSrcString, nNewLength - 1);
+    size_t nId = GetItemId(nIndex);
+    ChangeEvent Change = { .nType = CHANGE_ALTER, .nIndex = nIndex, .nId = nId,
+        .nPreviousIndex = nIndex, .nPreviousId = nId, .nLength = nNewLength };
+    PublishChange(&Change, lpSrcString);
+    TouchItem(nIndex);
+    UpdateVersion();
+    if (lpNewIndex != NULL)
+    {
+        *lpNewIndex = nIndex;
+    }
+
+    return true;
+}
+
+/*
+    Append a string to the end of string
+*/
+bool AppendToItem(size_t nIndex, const wchar_t *lpSuffix, size_t *lpNewIndex)
+{
+    assert(lpSuffix != NULL);
+
+    if (nIndex < g_lpDb->nCount)
+    {
+        size_t nLength = _ItemLength(&g_lpDb->IdxTab[nIndex]);
+        return SpliceItem(nIndex, nLength - 1, 0, lpSuffix, lpNewIndex);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+/*
+    Insert a string into string at offset
+*/
+bool InsertAtOffset(size_t nIndex, size_t nOffset,
+    const wchar_t *lpString, size_t *lpNewIndex)
+{
+    assert(lpString != NULL);
+
+    return SpliceItem(nIndex, nOffset, 0, lpString, lpNewIndex);
+}
+
+/*
+    Erase a range of string
+*/
+bool EraseRange(size_t nIndex, size_t nOffset, size_t nCount, size_t *lpNewIndex)
+{
+    // Shrinking is done on the same place unless the string is compressed
+    return SpliceItem(nIndex, nOffset, nCount, L"", lpNewIndex);
+}
+
+/*
+    Alter next matched string by content
+*/
+bool AlterNextByContent(const wchar_t *lpSrcString, size_t nBeginIndex,
+    const wchar_t *lpNewString, size_t *lpSrcIndex, size_t *lpNewIndex)
+{
+    assert(lpSrcString != NULL);
+    assert(lpNewString != NULL);
+    assert(nBeginIndex <= g_lpDb->nCount);
+
+    size_t nSrcIndex = 0;
+    if (QueryNextByContent(lpSrcString, nBeginIndex, &nSrcIndex) != NULL)
+    {
+        if (lpSrcIndex != NULL)
+        {
+            *lpSrcIndex = nSrcIndex;
+        }
+
+        return AlterByIndex(nSrcIndex, lpNewString, lpNewIndex);;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+/*
+    Alter all matched string by content
+*/
+size_t AlterAllByContent(const wchar_t *lpSrcString, const wchar_t *lpNewString)
+{
+    assert(lpSrcString != NULL);
+    assert(lpNewString != NULL);
+
+    size_t nAlterCount = 0, nAlterIndex = 0;
+    if (wcscmp(lpSrcString, lpNewString) != 0)
+    {
+        bool bResult = AlterNextByContent(lpSrcString,
+            nAlterIndex, lpNewString, &nAlterIndex, NULL);
+        while (bResult != false)
+        {
+            ++nAlterCount;
+            bResult = AlterNextByContent(lpSrcString,
+                nAlterIndex, lpNewString, &nAlterIndex, NULL);
+        }
+    }
+
+    return nAlterCount;
+}
+
+/*
+    Get the string id of a slot
+*/
+size_t SlotItemId(uint32_t nSlot)
+{
+    return ((size_t)g_lpDb->nSlotGeneration[nSlot] << SLOT_BITS) | nSlot;
+}
+
+/*
+    Assign a free slot to a new string
+*/
+uint32_t AcquireSlot()
+{
+    if (g_lpDb->nFreeSlotCount != 0)
+    {
+        return g_lpDb->nFreeSlots[--g_lpDb->nFreeSlotCount];
+    }
+    else
+    {
+        assert(g_lpDb->nSlotCount < MAX_STRING_COUNT);
+        return (uint32_t)g_lpDb->nSlotCount++;
+    }
+}
+
+/*
+    Release the slot of a deleted string
+*/
+void ReleaseSlot(uint32_t nSlot)
+{
+    assert(nSlot < g_lpDb->nSlotCount);
+
+    g_lpDb->nSlotIndex[nSlot] = INVALID_SLOT;
+    g_lpDb->nSlotGeneration[nSlot] = 
+        (g_lpDb->nSlotGeneration[nSlot] + 1) & ((1u << GENERATION_BITS) - 1);
+    g_lpDb->nFreeSlots[g_lpDb->nFreeSlotCount++] = nSlot;
+}
+
+/*
+    Relocate slots of shifted indexes
+*/
+void UpdateSlotMap(size_t nBegin, size_t nEnd)
+{
+    for (size_t i = nBegin; i != nEnd; ++i)
+    {
+        g_lpDb->nSlotIndex[g_lpDb->nSlotTab[i]] = (uint32_t)i;
+    }
+}
+
+/*
+    Insert a new string index to table
+*/
+void InsertIndex(size_t nLocation, wchar_t *lpString, size_t nLength)
+{
+    assert(nLocation <= g_lpDb->nCount);
+    assert(g_lpDb->nCount < MAX_STRING_COUNT);
+    assert(lpString != NULL);
+
+    size_t nRest = g_lpDb->nCount - nLocation;
+    memmove(&g_lpDb->IdxTab[nLocation + 1], &g_lpDb->IdxTab[nLocation], sizeof(Index) * nRest);
+    memmove(&g_lpDb->nTouchTab[nLocation + 1], 
+        &g_lpDb->nTouchTab[nLocation], sizeof(uint32_t) * nRest);
+    g_lpDb->nTouchTab[nLocation] = ++g_lpDb->nClock;
+    memmove(&g_lpDb->nCaseKeyTab[nLocation + 1], 
+        &g_lpDb->nCaseKeyTab[nLocation], sizeof(uint32_t) * nRest);
+    memmove(&g_lpDb->nNormKeyTab[nLocation + 1], 
+        &g_lpDb->nNormKeyTab[nLocation], sizeof(uint32_t) * nRest);
+    memmove(&g_lpDb->nSlotTab[nLocation + 1], 
+        &g_lpDb->nSlotTab[nLocation], sizeof(uint32_t) * nRest);
+    g_lpDb->nSlotTab[nLocation] = AcquireSlot();
+    UpdateSlotMap(nLocation, g_lpDb->nCount + 1);
+    SetFoldKeys(nLocation, lpString, nLength);
+    AddToSketches(&g_lpDb->Sketches, lpString, nLength - 1);
+    
+    if (g_lpDb->szStorage <= lpString && lpString < &g_lpDb->szStorage[STORAGE_SIZE])
+    {
+        assert(nLocation <= g_lpDb->nSmallCount);
+
+        g_lpDb->IdxTab[nLocation].nOffset = (uint32_t)(lpString - g_lpDb->szStorage);
+        ++g_lpDb->nSmallCount;
+    }
+    else
+    {
+        assert(nLocation >= g_lpDb->nSmallCount);
+
+        g_lpDb->IdxTab[nLocation].nOffset = 
+            (uint32_t)(STORAGE_SIZE + (lpString - g_lpDb->szLargeStorage));
+    }
+
+    g_lpDb->IdxTab[nLocation].nLength = (uint32_t)nLength;
+    g_lpDb->IdxTab[nLocation].bCompressed = false;
+    // Count is increased after, so id is made from slot
+    size_t nId = SlotItemId(g_lpDb->nSlotTab[nLocation]);
+    ChangeEvent Change = { .nType = CHANGE_STORE, .nIndex = nLocation, .nId = nId,
+        .nPreviousIndex = nLocation, .nPreviousId = nId, .nLength = nLength };
+    PublishChange(&Change, lpString);
+    UpdateVersion();
+}
+
+/*
+    Delete a string index from table
+*/
+void DeleteIndex(size_t nLocation)
+{
+    assert(nLocation < g_lpDb->nCount);
+
+    if (nLocation < g_lpDb->nSmallCount)
+    {
+        --g_lpDb->nSmallCount;
+    }
+
+    size_t nId = SlotItemId(g_lpDb->nSlotTab[nLocation]);
+    ReleaseSlot(g_lpDb->nSlotTab[nLocation]);
+    size_t nRest = g_lpDb->nCount - nLocation - 1;
+    memmove(&g_lpDb->IdxTab[nLocation], &g_lpDb->IdxTab[nLocation + 1], sizeof(Index) * nRest);
+    memmove(&g_lpDb->nTouchTab[nLocation], 
+        &g_lpDb->nTouchTab[nLocation + 1], sizeof(uint32_t) * nRest);
+    memmove(&g_lpDb->nCaseKeyTab[nLocation], 
+        &g_lpDb->nCaseKeyTab[nLocation + 1], sizeof(uint32_t) * nRest);
+    memmove(&g_lpDb->nNormKeyTab[nLocation], 
+        &g_lpDb->nNormKeyTab[nLocation + 1], sizeof(uint32_t) * nRest);
+    memmove(&g_lpDb->nSlotTab[nLocation], 
+        &g_lpDb->nSlotTab[nLocation + 1], sizeof(uint32_t) * nRest);
+    UpdateSlotMap(nLocation, g_lpDb->nCount - 1);
+    
+    // Set invalid index to NULL
+    memset(&g_lpDb->IdxTab[g_lpDb->nCount - 1], 0, sizeof(Index));
+    g_lpDb->nTouchTab[g_lpDb->nCount - 1] = 0;
+    g_lpDb->nCaseKeyTab[g_lpDb->nCount - 1] = 0;
+    g_lpDb->nNormKeyTab[g_lpDb->nCount - 1] = 0;
+    g_lpDb->nSlotTab[g_lpDb->nCount - 1] = 0;
+    ChangeEvent Change = { .nType = CHANGE_DELETE, .nIndex = nLocation, .nId = nId,
+        .nPreviousIndex = nLocation, .nPreviousId = nId };
+    PublishChange(&Change, NULL);
+    UpdateVersion();
+}
+
+/*
+    Create an empty database
+*/
+Database *CreateDatabase()
+{
+    Database *lpDatabase = calloc(1, sizeof(Database));
+    if (lpDatabase != NULL)
+    {
+        lpDatabase->nLargeThreshold = LARGE_STRING_THRESHOLD;
+    }
+
+    return lpDatabase;
+}
+
+/*
+    Destroy a database created by CreateDatabase
+*/
+void DestroyDatabase(Database *lpDatabase)
+{
+    assert(lpDatabase != NULL);
+    assert(lpDatabase != &g_DefaultDatabase);
+
+    // Cached query results are allocated
+    Database *lpPrevious = SelectDatabase(lpDatabase);
+    for (size_t i = 0; i != QUERY_CACHE_COUNT; ++i)
+    {
+        DropQueryCache(&g_lpDb->QueryCache[i]);
+    }
+
+    SelectDatabase((lpPrevious != lpDatabase) ? lpPrevious : NULL);
+    while (lpDatabase->lpPinChunks != NULL)
+    {
+        PinChunk *lpNext = lpDatabase->lpPinChunks->lpNext;
+        free(lpDatabase->lpPinChunks);
+        lpDatabase->lpPinChunks = lpNext;
+    }
+
+    free(lpDatabase);
+}
+
+/*
+    Select the database for current thread to work on
+*/
+Database *SelectDatabase(Database *lpDatabase)
+{
+    Database *lpPrevious = g_lpDb;
+    g_lpDb = (lpDatabase != NULL) ? lpDatabase : &g_DefaultDatabase;
+    return lpPrevious;
+}
+
+/*
+    Clear database
+*/
+void ClearDatabase()
+{
+    // Ids of cleared strings are never valid again
+    for (size_t i = 0; i != g_lpDb->nCount; ++i)
+    {
+        ReleaseSlot(g_lpDb->nSlotTab[i]);
+    }
+
+    memset(g_lpDb->nSlotTab, 0, sizeof(g_lpDb->nSlotTab));
+    memset(g_lpDb->szStorage, '\0', sizeof(g_lpDb->szStorage));
+    memset(g_lpDb->szLargeStorage, '\0', sizeof(g_lpDb->szLargeStorage));
+    memset(g_lpDb->bExtentUsed, 0, sizeof(g_lpDb->bExtentUsed));
+    memset(g_lpDb->IdxTab, 0, sizeof(g_lpDb->IdxTab));
+    g_lpDb->nUsedSize = 0;
+    g_lpDb->nUsedExtents = 0;
+    g_lpDb->nCount = 0;
+    g_lpDb->nSmallCount = 0;
+
+    memset(g_lpDb->nTouchTab, 0, sizeof(g_lpDb->nTouchTab));
+    memset(g_lpDb->nCaseKeyTab, 0, sizeof(g_lpDb->nCaseKeyTab));
+    memset(g_lpDb->nNormKeyTab, 0, sizeof(g_lpDb->nNormKeyTab));
+    g_lpDb->nClock = 0;
+    memset(&g_lpDb->Dictionary, 0, sizeof(g_lpDb->Dictionary));
+    g_lpDb->nCompressedCount = 0;
+    memset(&g_lpDb->Sketches, 0, sizeof(g_lpDb->Sketches));
+
+    for (size_t i = 0; i != QUERY_CACHE_COUNT; ++i)
+    {
+        DropQueryCache(&g_lpDb->QueryCache[i]);
+    }
+
+    ChangeEvent Change = { .nType = CHANGE_CLEAR, .nId = SIZE_MAX, .nPreviousId = SIZE_MAX };
+    PublishChange(&Change, NULL);
+    UpdateVersion();
+}
+
+/*
+    Defrag database, put all strings together and clear fragments
+*/
+size_t DefragDatabase()
+{
+    // Large strings are never moved, and once a string is moved,
+    // all small strings behind it are moved
+    wchar_t *lpDest = g_lpDb->szStorage;
+    size_t nFirstMoved = g_lpDb->nSmallCount;
+    for (size_t i = 0; i != g_lpDb->nSmallCount; ++i)
+    {
+        // MoveString clears the source, strings in place are skipped
+        Index *lpIndex = &g_lpDb->IdxTab[i];
+        wchar_t *lpSrc = _IndexData(lpIndex);
+        if (lpSrc != lpDest)
+        {
+            MoveString(lpDest, lpSrc, lpIndex->nLength);
+            lpIndex->nOffset = (uint32_t)(lpDest - g_lpDb->szStorage);
+            nFirstMoved = (nFirstMoved < i) ? nFirstMoved : i;
+        }
+
+        lpDest += lpIndex->nLength;     // Store one next to one
+    }
+
+    // Pointers of moved strings are invalid, nothing is changed otherwise
+    if (nFirstMoved != g_lpDb->nSmallCount)
+    {
+        ChangeEvent Change = { .nType = CHANGE_RELOCATE, .nIndex = nFirstMoved, 
+            .nId = SIZE_MAX, .nPreviousIndex = nFirstMoved, .nPreviousId = SIZE_MAX,
+            .nLength = g_lpDb->nSmallCount - nFirstMoved };
+        PublishChange(&Change, NULL);
+        UpdateVersion();
+    }
+
+    return GetFreeSize();
+}
+
+/*
+    Map a file to memory for reading
+*/
+bool MapFile(const wchar_t *lpFileName, MappedFile *lpFile)
+{
+    assert(lpFileName != NULL);
+    assert(lpFile != NULL);
+
+    memset(lpFile, 0, sizeof(MappedFile));
+
+#ifdef _WIN32
+    HANDLE hFile = CreateFileW(lpFileName, GENERIC_READ, FILE_SHARE_READ,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER FileSize;
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    else if (GetFileSizeEx(hFile, &FileSize) == FALSE)
+    {
+        CloseHandle(hFile);
+        return false;
+    }
+
+    lpFile->hFile = hFile;
+    lpFile->nSize = (size_t)FileSize.QuadPart;
+    if (lpFile->nSize != 0)
+    {
+        // Empty file can not be mapped
+        lpFile->hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (lpFile->hMapping != NULL)
+        {
+            lpFile->lpData = MapViewOfFile(lpFile->hMapping, FILE_MAP_READ, 0, 0, 0);
+        }
+
+        if (lpFile->lpData == NULL)
+        {
+            UnmapFile(lpFile);
+            return false;
+        }
+    }
+#else
+    // File names are UTF-8 whatever the locale is, leave room for '\0'
+    uint8_t szFileName[4096];
+    size_t nNameSize = EncodeUtf8(lpFileName, wcslen(lpFileName),
+        szFileName, sizeof(szFileName) - 1);
+    if (nNameSize == SIZE_MAX)
+    {
+        return false;
+    }
+
+    szFileName[nNameSize] = '\0';
+
+    int nFile = open((const char *)szFileName, O_RDONLY);
+    struct stat FileStat;
+    if (nFile == -1)
+    {
+        return false;
+    }
+    else if (fstat(nFile, &FileStat) == -1)
+    {
+        close(nFile);
+        return false;
+    }
+
+    lpFile->nSize = (size_t)FileStat.st_size;
+    if (lpFile->nSize != 0)
+    {
+        // Empty file can not be mapped
+        void *lpData = mmap(NULL, lpFile->nSize, PROT_READ, MAP_PRIVATE, nFile, 0);
+        if (lpData == MAP_FAILED)
+        {
+            close(nFile);
+            return false;
+        }
+
+        madvise(lpData, lpFile->nSize, MADV_SEQUENTIAL);
+        lpFile->lpData = lpData;
+    }
+
+    // Mapping keeps the file referenced
+    close(nFile);
+#endif
+
+    return true;
+}
+
+/*
+    Unmap a file mapped by MapFile
+*/
+void UnmapFile(MappedFile *lpFile)
+{
+    assert(lpFile != NULL);
+
+#ifdef _WIN32
+    if (lpFile->lpData != NULL)
+    {
+        UnmapViewOfFile(lpFile->lpData);
+    }
+
+    if (lpFile->hMapping != NULL)
+    {
+        CloseHandle(lpFile->hMapping);
+    }
+
+    if (lpFile->hFile != NULL)
+    {
+        CloseHandle(lpFile->hFile);
+    }
+#else
+    if (lpFile->lpData != NULL)
+    {
+        munmap((void *)lpFile->lpData, lpFile->nSize);
+    }
+#endif
+
+    memset(lpFile, 0, sizeof(MappedFile));
+}
+
+/*
+    Load strings from a UTF-8 text file
+*/
+bool LoadFromFile(const wchar_t *lpFileName, LoadResult *lpResult)
+{
+    assert(lpFileName != NULL);
+    assert(lpResult != NULL);
+
+    memset(lpResult, 0, sizeof(LoadResult));
+
+    struct timespec Begin, End;
+    timespec_get(&Begin, TIME_UTC);
+
+    MappedFile File;
+    if (MapFile(lpFileName, &File) == false)
+    {
+        return false;
+    }
+
+    // Free space of small storage is one block at the end after defrag,
+    // strings are packed into it one next to one
+    DefragDatabase();
+    size_t nEnd = g_lpDb->nUsedSize;
 
-    size_t nLength = wcslen(lpString) + 1;
-    for (size_t i = nBeginIndex; i < g_nCount; ++i)
+    const uint8_t *lpCursor = File.lpData;
+    const uint8_t *lpFileEnd = File.lpData + File.nSize;
+    if (File.nSize >= 3 && memcmp(lpCursor, "\xEF\xBB\xBF", 3) == 0)
+    {
+        // Skip BOM
+        lpCursor += 3;
+    }
+
+    while (lpCursor < lpFileEnd)
     {
-        if (g_IdxTab[i].nLength == nLength
-            && wcscmp(lpString, g_IdxTab[i].lpData) == 0)
+        // Strings are separated by '\n' or '\0', empty lines are skipped
+        const uint8_t *lpRecordEnd = lpCursor;
+        while (lpRecordEnd != lpFileEnd && *lpRecordEnd != '\n' && *lpRecordEnd != '\0')
         {
-            if (lpMatchIndex != NULL)
+            ++lpRecordEnd;
+        }
+
+        size_t nRecordSize = lpRecordEnd - lpCursor;
+        if (nRecordSize != 0 && lpCursor[nRecordSize - 1] == '\r')
+        {
+            --nRecordSize;
+        }
+
+        if (nRecordSize != 0)
+        {
+            // Small strings are decoded into storage directly
+            size_t nCapacity = STORAGE_SIZE - nEnd;
+            if (nCapacity > g_lpDb->nLargeThreshold)
             {
-                *lpMatchIndex = i;
+                nCapacity = g_lpDb->nLargeThreshold;
+            }
+
+            size_t nLength = SIZE_MAX;
+            if (nCapacity >= 2)
+            {
+                nLength = DecodeUtf8(lpCursor, nRecordSize, 
+                    &g_lpDb->szStorage[nEnd], nCapacity - 1);
+            }
+
+            if (nLength != SIZE_MAX && g_lpDb->nCount != MAX_STRING_COUNT)
+            {
+                InsertIndex(g_lpDb->nSmallCount, &g_lpDb->szStorage[nEnd], nLength + 1);
+                nEnd += nLength + 1;
+                g_lpDb->nUsedSize += nLength + 1;
+                ++g_lpDb->nCount;
+                ++lpResult->nLoadCount;
             }
+            else
+            {
+                // Clear partly decoded string, then store as large string
+                if (nCapacity >= 2)
+                {
+                    memset(&g_lpDb->szStorage[nEnd], '\0', (nCapacity - 1) * sizeof(wchar_t));
+                }
+
+                nLength = DecodeUtf8(lpCursor, nRecordSize, 
+                    g_lpDb->szSpliceBuffer, MAX_STRING_LENGTH - 1);
+                if (nLength != SIZE_MAX)
+                {
+                    g_lpDb->szSpliceBuffer[nLength] = L'\0';
+                }
 
-            return g_IdxTab[i].lpData;
+                if (nLength != SIZE_MAX && Store(g_lpDb->szSpliceBuffer, NULL) == true)
+                {
+                    ++lpResult->nLoadCount;
+                }
+                else
+                {
+                    ++lpResult->nDropCount;
+                }
+            }
         }
+
+        lpCursor = (lpRecordEnd != lpFileEnd) ? lpRecordEnd + 1 : lpFileEnd;
     }
 
-    return NULL;
-}
+    lpResult->nByteCount = File.nSize;
+    UnmapFile(&File);
 
-const wchar_t *QueryNextByContent(
-    const wchar_t *lpString, size_t nBeginIndex, size_t *lpMatchIndex)
-{
-    return _QueryNextByContent(lpString, nBeginIndex, lpMatchIndex);
+    timespec_get(&End, TIME_UTC);
+    lpResult->dSeconds = (double)(End.tv_sec - Begin.tv_sec)
+        + (double)(End.tv_nsec - Begin.tv_nsec) / 1e9;
+    if (lpResult->dSeconds > 0)
+    {
+        lpResult->dMegabytesPerSecond = (double)lpResult->nByteCount / 1e6 / lpResult->dSeconds;
+    }
+
+    return true;
 }
 
 /*
-    Query all strings by content
+    Train shared dictionary from strings in storage
 */
-const QueryRecord *QueryAllByContent(const wchar_t *lpString, size_t *lpMatchCount)
+bool TrainDictionary()
 {
-    assert(lpString != NULL);
-    assert(lpMatchCount != NULL);
+    // Compressed strings depend on current dictionary
+    if (g_lpDb->nCompressedCount != 0)
+    {
+        return false;
+    }
 
-    ClearQueryRecords();
+    // Only small strings are compressed, train on them without the
+    // holes between them
+    assert(STORAGE_SIZE <= MAX_STRING_LENGTH);
 
-    size_t nMatchCount = 0, nMatchIndex = 0;
-    wchar_t *lpResult = _QueryNextByContent(lpString, nMatchIndex, &nMatchIndex);
-    while (lpResult != NULL)
+    size_t nSampleSize = 0;
+    for (size_t i = 0; i != g_lpDb->nSmallCount; ++i)
     {
-        g_QueryRecords[nMatchCount].lpData = lpResult;
-        g_QueryRecords[nMatchCount].nIndex = nMatchIndex;
-        ++nMatchCount;
+        const Index *lpIndex = &g_lpDb->IdxTab[i];
+        wmemcpy(&g_lpDb->szThawBuffer[nSampleSize], _IndexData(lpIndex), lpIndex->nLength);
+        nSampleSize += lpIndex->nLength;
+    }
 
-        lpResult = _QueryNextByContent(lpString, nMatchIndex + 1, &nMatchIndex);
+    if (TrainSymbolTable(&g_lpDb->Dictionary, g_lpDb->szThawBuffer, nSampleSize) == false)
+    {
+        g_lpDb->Dictionary.nCount = 0;
+        return false;
     }
 
-    *lpMatchCount = nMatchCount;
-    return g_QueryRecords;
+    return true;
 }
 
 /*
-    Fuzzy query all strings by content
+    Compress strings which are not touched for a while
 */
-const QueryRecord *FuzzyQueryAllByContent(const wchar_t *lpString, size_t *lpMatchCount)
+size_t CompressColdItems(size_t nIdleTicks)
 {
-    assert(lpString != NULL);
-    assert(lpMatchCount != NULL);
-
-    ClearQueryRecords();
+    if (g_lpDb->Dictionary.nCount == 0 && TrainDictionary() == false)
+    {
+        return 0;
+    }
 
-    size_t nMatchCount = 0;
-    for (size_t i = 0; i != g_nCount; ++i)
+    // Only small strings are compressed, large strings are never moved
+    size_t nCompressCount = 0;
+    for (size_t i = 0; i != g_lpDb->nSmallCount; ++i)
     {
-        if (wcsstr(g_IdxTab[i].lpData, lpString) != NULL)
+        if ((uint32_t)(g_lpDb->nClock - g_lpDb->nTouchTab[i]) >= nIdleTicks
+            && CompressItem(i) == true)
         {
-            g_QueryRecords[nMatchCount].lpData = g_IdxTab[i].lpData;
-            g_QueryRecords[nMatchCount].nIndex = i;
-            ++nMatchCount;
+            ++nCompressCount;
         }
     }
 
-    *lpMatchCount = nMatchCount;
-    return g_QueryRecords;
+    return nCompressCount;
 }
 
 /*
-    Delete string by index
+    Get compressed string count in database
 */
-bool DeleteByIndex(size_t nIndex)
+size_t GetCompressedCount()
 {
-    size_t nLength = 0;
-    wchar_t *lpString = _GetItem(nIndex, &nLength);
-    if (lpString != NULL)
-    {
-        memset(lpString, '\0', nLength * sizeof(wchar_t));
-        DeleteIndex(nIndex);
-        --g_nCount;
-        g_nUsedSize -= nLength;
-        return true;
-    }
-    else
-    {
-        return false;
-    }
+    return g_lpDb->nCompressedCount;
 }
 
 /*
-    Delete next matched string by content
+    Compress string in place by shared dictionary
 */
-bool DeleteNextByContent(const wchar_t *lpString, 
-    size_t nBeginIndex, size_t *lpDeleteIndex)
+bool CompressItem(size_t nIndex)
 {
-    assert(lpString != NULL);
-    assert(nBeginIndex <= g_nCount);
+    assert(nIndex < g_lpDb->nSmallCount);
 
-    size_t nDeleteIndex = 0;
-    if (QueryNextByContent(lpString, nBeginIndex, &nDeleteIndex) != NULL)
+    Index *lpIndex = &g_lpDb->IdxTab[nIndex];
+    size_t nLength = lpIndex->nLength;
+    if (lpIndex->bCompressed == true || nLength <= COMPRESSED_HEADER_SIZE + 1)
     {
-        DeleteByIndex(nDeleteIndex);
-        if (lpDeleteIndex != NULL)
-        {
-            *lpDeleteIndex = nDeleteIndex;
-        }
-
-        return true;
+        return false;
     }
-    else
+
+    // Codes and header must take less space than the string
+    wchar_t *lpData = _IndexData(lpIndex);
+    size_t nMaxSize = (nLength - COMPRESSED_HEADER_SIZE - 1) * sizeof(wchar_t);
+    size_t nCodeSize = EncodeString(&g_lpDb->Dictionary, 
+        lpData, nLength - 1, g_lpDb->CodeBuffer, nMaxSize);
+    if (nCodeSize == 0)
     {
         return false;
     }
+
+    size_t nNewLength = COMPRESSED_HEADER_SIZE 
+        + (nCodeSize + sizeof(wchar_t) - 1) / sizeof(wchar_t);
+    memset(lpData, '\0', nLength * sizeof(wchar_t));
+    lpData[0] = (wchar_t)nLength;
+    lpData[1] = (wchar_t)nCodeSize;
+    memcpy(&lpData[COMPRESSED_HEADER_SIZE], g_lpDb->CodeBuffer, nCodeSize);
+
+    lpIndex->nLength = (uint32_t)nNewLength;
+    lpIndex->bCompressed = true;
+    g_lpDb->nUsedSize -= (nLength - nNewLength);
+    ++g_lpDb->nCompressedCount;
+    return true;
 }
 
 /*
-    Delete all matched string by content
+    Decompress string of an index
 */
-size_t DeleteAllByContent(const wchar_t *lpString)
+void DecodeItem(const Index *lpIndex, wchar_t *lpOutput)
 {
-    assert(lpString != NULL);
-
-    size_t nDeleteCount = 0, nDeleteIndex = 0;
-    bool bResult = DeleteNextByContent(lpString, nDeleteIndex, &nDeleteIndex);
-    while (bResult != false)
-    {
-        ++nDeleteCount;
-        bResult = DeleteNextByContent(lpString, nDeleteIndex, &nDeleteIndex);
-    }
-
-    return nDeleteCount;
+    assert(lpIndex != NULL);
+    assert(lpIndex->bCompressed == true);
+    assert(lpOutput != NULL);
+
+    const wchar_t *lpData = _IndexData(lpIndex);
+    size_t nLength = DecodeString(&g_lpDb->Dictionary, 
+        (const uint8_t *)&lpData[COMPRESSED_HEADER_SIZE], 
+        (size_t)lpData[1], lpOutput, (size_t)lpData[0] - 1);
+    lpOutput[nLength] = L'\0';
 }
 
 /*
-    Alter string by index
+    Get decompressed string of an index, decompress it if not pinned
 */
-bool AlterByIndex(size_t nIndex, const wchar_t *lpNewString, size_t *lpNewIndex)
+wchar_t *FetchPinnedItem(const Index *lpIndex)
 {
-    assert(lpNewString != NULL);
+    assert(lpIndex != NULL);
+    assert(lpIndex->bCompressed == true);
 
-    size_t nSrcLength = 0;
-    wchar_t *lpSrcString = _GetItem(nIndex, &nSrcLength);
-    if (lpSrcString != NULL)
+    // Indexes and strings are not changed until database version is changed
+    if (g_lpDb->nPinVersion != g_lpDb->nVersion)
     {
-        size_t nNewLength = wcslen(lpNewString) + 1;
-        if (nNewLength <= nSrcLength)
+        memset(g_lpDb->lpPinTab, 0, sizeof(g_lpDb->lpPinTab));
+        for (PinChunk *lpChunk = g_lpDb->lpPinChunks; lpChunk != NULL; lpChunk = lpChunk->lpNext)
         {
-            // Alter on the same place
-            memset(lpSrcString, '\0', nSrcLength * sizeof(wchar_t));
-            wcscpy(lpSrcString, lpNewString);
-            g_IdxTab[nIndex].nLength = nNewLength;
-            g_nUsedSize -= (nSrcLength - nNewLength);
-            if (lpNewIndex != NULL)
-            {
-                *lpNewIndex = nIndex;
-            }
-
-            return true;
+            lpChunk->nUsedSize = 0;
         }
-        else if (nNewLength - nSrcLength <= GetFreeSize())
+
+        g_lpDb->lpPinChunk = g_lpDb->lpPinChunks;
+        g_lpDb->nPinVersion = g_lpDb->nVersion;
+    }
+
+    size_t nIndex = (size_t)(lpIndex - g_lpDb->IdxTab);
+    if (g_lpDb->lpPinTab[nIndex] == NULL)
+    {
+        wchar_t *lpData = ReservePinSpace(_ItemLength(lpIndex));
+        if (lpData != NULL)
         {
-            // Delete source and find a new place to store
-            DeleteByIndex(nIndex);
-            return Store(lpNewString, lpNewIndex);
+            DecodeItem(lpIndex, lpData);
+            g_lpDb->lpPinTab[nIndex] = lpData;
         }
     }
 
-    return false;
+    return g_lpDb->lpPinTab[nIndex];
 }
 
 /*
-    Alter next matched string by content
+    Reserve space of pinned strings
 */
-bool AlterNextByContent(const wchar_t *lpSrcString, size_t nBeginIndex,
-    const wchar_t *lpNewString, size_t *lpSrcIndex, size_t *lpNewIndex)
+wchar_t *ReservePinSpace(size_t nLength)
 {
-    assert(lpSrcString != NULL);
-    assert(lpNewString != NULL);
-    assert(nBeginIndex <= g_nCount);
+    assert(nLength <= PIN_CHUNK_SIZE);
 
-    size_t nSrcIndex = 0;
-    if (QueryNextByContent(lpSrcString, nBeginIndex, &nSrcIndex) != NULL)
+    // Move to the next chunk, or add one, if current chunk is full
+    PinChunk *lpChunk = g_lpDb->lpPinChunk;
+    while (lpChunk == NULL || lpChunk->nUsedSize + nLength > PIN_CHUNK_SIZE)
     {
-        if (lpSrcIndex != NULL)
+        if (lpChunk != NULL && lpChunk->lpNext != NULL)
         {
-            *lpSrcIndex = nSrcIndex;
+            lpChunk = lpChunk->lpNext;
+            continue;
         }
 
-        return AlterByIndex(nSrcIndex, lpNewString, lpNewIndex);;
-    }
-    else
-    {
-        return false;
-    }
-}
-
-/*
-    Alter all matched string by content
-*/
-size_t AlterAllByContent(const wchar_t *lpSrcString, const wchar_t *lpNewString)
-{
-    assert(lpSrcString != NULL);
-    assert(lpNewString != NULL);
+        PinChunk *lpNew = malloc(sizeof(PinChunk));
+        if (lpNew == NULL)
+        {
+            return NULL;
+        }
 
-    size_t nAlterCount = 0, nAlterIndex = 0;
-    if (wcscmp(lpSrcString, lpNewString) != 0)
-    {
-        bool bResult = AlterNextByContent(lpSrcString,
-            nAlterIndex, lpNewString, &nAlterIndex, NULL);
-        while (bResult != false)
+        lpNew->lpNext = NULL;
+        lpNew->nUsedSize = 0;
+        if (lpChunk != NULL)
         {
-            ++nAlterCount;
-            bResult = AlterNextByContent(lpSrcString,
-                nAlterIndex, lpNewString, &nAlterIndex, NULL);
+            lpChunk->lpNext = lpNew;
+        }
+        else
+        {
+            g_lpDb->lpPinChunks = lpNew;
         }
+
+        lpChunk = lpNew;
     }
 
-    return nAlterCount;
+    g_lpDb->lpPinChunk = lpChunk;
+    wchar_t *lpSpace = &lpChunk->szData[lpChunk->nUsedSize];
+    lpChunk->nUsedSize += nLength;
+    return lpSpace;
 }
 
 /*
-    Insert a new string index to table
+    Get the total size of storage
 */
-void InsertIndex(size_t nLocation, wchar_t *lpString)
+size_t GetTotalSize()
 {
-    assert(nLocation <= g_nCount);
-    assert(lpString != NULL);
-
-    size_t nRest = g_nCount - nLocation;
-    memmove(&g_IdxTab[nLocation + 1], &g_IdxTab[nLocation], sizeof(Index) * nRest);
-    
-    g_IdxTab[nLocation].lpData = lpString;
-    g_IdxTab[nLocation].nLength = wcslen(lpString) + 1;
+    return STORAGE_SIZE;
 }
 
 /*
-    Delete a string index from table
+    Get the used size of storage
 */
-void DeleteIndex(size_t nLocation)
+size_t GetUsedSize()
 {
-    assert(nLocation < g_nCount);
+    return g_lpDb->nUsedSize;
+}
 
-    size_t nRest = g_nCount - nLocation - 1;
-    memmove(&g_IdxTab[nLocation], &g_IdxTab[nLocation + 1], sizeof(Index) * nRest);
-    
-    // Set invalid index to NULL
-    memset(&g_IdxTab[g_nCount - 1], 0, sizeof(Index));
+/*
+    Get the free size of storage
+*/
+size_t GetFreeSize()
+{
+    return STORAGE_SIZE - g_lpDb->nUsedSize;
 }
 
 /*
-    Clear database
+    Get the total size of large storage
 */
-void ClearDatabase()
+size_t GetLargeTotalSize()
 {
-    memset(g_szStorage, '\0', sizeof(g_szStorage));
-    memset(g_IdxTab, 0, sizeof(g_IdxTab));
-    g_nUsedSize = 0;
-    g_nCount = 0;
+    return LARGE_STORAGE_SIZE;
 }
 
 /*
-    Defrag database, put all strings together and clear fragments
+    Get the used size of large storage
 */
-size_t DefragDatabase()
+size_t GetLargeUsedSize()
 {
-    wchar_t *lpDest = g_szStorage;
-    for (size_t i = 0; i != g_nCount; ++i)
-    {
-        Index *lpIndex = &g_IdxTab[i];
-        MoveString(lpDest, lpIndex->lpData);
-        lpIndex->lpData = lpDest;
-        lpDest += lpIndex->nLength;     // Store one next to one
-    }
+    return g_lpDb->nUsedExtents * EXTENT_SIZE;
+}
 
-    return GetFreeSize();
+/*
+    Get the free size of large storage
+*/
+size_t GetLargeFreeSize()
+{
+    return LARGE_STORAGE_SIZE - g_lpDb->nUsedExtents * EXTENT_SIZE;
 }
 
 /*
-    Get the total size of storage
+    Get string count in database
 */
-size_t GetTotalSize()
+size_t GetItemCount()
 {
-    return STORAGE_SIZE;
+    return g_lpDb->nCount;
 }
 
 /*
-    Get the used size of storage
+    Get storage pointer
 */
-size_t GetUsedSize()
+const wchar_t GetStorage()
 {
-    return g_nUsedSize;
+    return g_lpDb->szStorage;
 }
 
 /*
-    Get the free size of storage
+    Get the most frequent strings in database
 */
-size_t GetFreeSize()
+size_t GetFrequentStrings(FrequentItem *lpItems, size_t nMaxCount)
 {
-    return STORAGE_SIZE - g_nUsedSize;
+    return GetHeavyHitters(&g_lpDb->Sketches.FrequentStrings, lpItems, nMaxCount);
 }
 
 /*
-    Get string count in database
+    Get the most frequent character n-grams in strings of database
 */
-size_t GetItemCount()
+size_t GetFrequentNGrams(size_t nGramLength, FrequentItem *lpItems, size_t nMaxCount)
 {
-    return g_nCount;
+    if (nGramLength == 2)
+    {
+        return GetHeavyHitters(&g_lpDb->Sketches.FrequentBigrams, lpItems, nMaxCount);
+    }
+    else if (nGramLength == 3)
+    {
+        return GetHeavyHitters(&g_lpDb->Sketches.FrequentTrigrams, lpItems, nMaxCount);
+    }
+    else
+    {
+        return 0;
+    }
 }
 
 /*
-    Get storage pointer
+    Estimate the count of a string in database
 */
-const wchar_t GetStorage()
+size_t EstimateStringCount(const wchar_t *lpString)
 {
-    return g_szStorage;
+    assert(lpString != NULL);
+
+    return EstimateCount(&g_lpDb->Sketches, lpString, wcslen(lpString));
 }
 
 /*
-    Count the number and frequency of '0'~'9', 'a'~'z' and 'A'~'Z'
+    Estimate the number of distinct strings ever stored
 */
-bool Statistic(size_t *lpCounts, size_t nSize, size_t *lpTotal)
+size_t EstimateDistinctCount()
 {
-    assert(lpCounts != NULL);
+    return EstimateCardinality(&g_lpDb->Sketches.Distinct);
+}
 
+/*
+    Count '0'~'9', 'A'~'Z' and 'a'~'z' in characters
+*/
+void CountChars(const wchar_t *lpString, size_t nLength, size_t *lpCounts)
+{
     /*
         Char: '0' ~ '9'
         ASCII: 0x30 ~ 0x39
@@ -512,30 +2247,75 @@ bool Statistic(size_t *lpCounts, size_t nSize, size_t *lpTotal)
         Index = ASCII - 0x3D
     */
 
+    for (size_t i = 0; i != nLength; ++i)
+    {
+        wchar_t cha = lpString[i];
+        if (L'0' <= cha && cha <= L'9')
+        {
+            ++lpCounts[cha - 0x30];
+        }
+        else if (L'A' <= cha && cha <= L'Z')
+        {
+            ++lpCounts[cha - 0x37];
+        }
+        else if (L'a' <= cha && cha <= L'z')
+        {
+            ++lpCounts[cha - 0x3D];
+        }
+    }
+}
+
+/*
+    Count the number and frequency of '0'~'9', 'a'~'z' and 'A'~'Z'
+*/
+bool Statistic(size_t *lpCounts, size_t nSize, size_t *lpTotal)
+{
+    assert(lpCounts != NULL);
+
     if (nSize >= MIN_STAT_SIZE)
     {
+        // Codes of compressed strings are counted, and characters
+        // of each symbol are counted once at last
+        size_t nCodeCounts[MAX_SYMBOL_COUNT] = { 0 };
         size_t nTotal = 0;
-        for (size_t i = 0; i != g_nCount; ++i)
+        for (size_t i = 0; i != g_lpDb->nCount; ++i)
         {
-            wchar_t *lpString = g_IdxTab[i].lpData;
-            for (size_t j = 0; j != g_IdxTab[i].nLength - 1; ++j)
+            const Index *lpIndex = &g_lpDb->IdxTab[i];
+            const wchar_t *lpString = _IndexData(lpIndex);
+            if (lpIndex->bCompressed == false)
             {
-                ++nTotal;
+                CountChars(lpString, lpIndex->nLength - 1, lpCounts);
+                nTotal += lpIndex->nLength - 1;
+                continue;
+            }
 
-                wchar_t cha = lpString[j];
-                if (L'0' <= cha && cha <= L'9')
-                {
-                    ++lpCounts[cha - 0x30];
-                }
-                else if (L'A' <= cha && cha <= L'Z')
+            const uint8_t *lpCodes = (const uint8_t *)&lpString[COMPRESSED_HEADER_SIZE];
+            for (size_t j = 0; j != (size_t)lpString[1];)
+            {
+                if (lpCodes[j] == ESCAPE_CODE)
                 {
-                    ++lpCounts[cha - 0x37];
+                    wchar_t cChar;
+                    memcpy(&cChar, &lpCodes[j + 1], sizeof(wchar_t));
+                    CountChars(&cChar, 1, lpCounts);
+                    j += 1 + sizeof(wchar_t);
                 }
-                else if (L'a' <= cha && cha <= L'z')
+                else
                 {
-                    ++lpCounts[cha - 0x3D];
+                    ++nCodeCounts[lpCodes[j]];
+                    ++j;
                 }
             }
+
+            nTotal += _ItemLength(lpIndex) - 1;
+        }
+
+        for (size_t i = 0; i != g_lpDb->Dictionary.nCount; ++i)
+        {
+            const Symbol *lpSymbol = &g_lpDb->Dictionary.Symbols[i];
+            for (size_t j = 0; j != nCodeCounts[i]; ++j)
+            {
+                CountChars(lpSymbol->szData, lpSymbol->nLength, lpCounts);
+            }
         }
 
         if (lpTotal != NULL)
@@ -554,12 +2334,11 @@ bool Statistic(size_t *lpCounts, size_t nSize, size_t *lpTotal)
 /*
     Move string from source to dest, and set invalid data to '\0'
 */
-void MoveString(wchar_t *lpDest, wchar_t *lpSrc)
+void MoveString(wchar_t *lpDest, wchar_t *lpSrc, size_t nLength)
 {
     assert(lpDest != NULL);
-    assert(lpDest != NULL);
+    assert(lpSrc != NULL);
 
-    size_t nLength = wcslen(lpSrc) + 1;
     if (lpSrc < lpDest && lpDest < lpSrc + nLength)
     {
         wchar_t *lpSrcData = lpSrc + nLength - 1;
@@ -7,21 +7,332 @@
 #pragma once
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "StrDb.h"
+#include "StrDbCodec.h"
+#include "StrDbSketch.h"
 
 #define STORAGE_SIZE        1000
 
-// The number of characters in shortest string is 2, including '\0'
-#define MAX_STRING_COUNT    STORAGE_SIZE / 2
+// Large strings are stored in extents of a separate pool, which are never
+// moved by defragment, and leave no holes in the small string storage
+#define LARGE_STORAGE_SIZE  4096
+#define EXTENT_SIZE         64
+#define EXTENT_COUNT        (LARGE_STORAGE_SIZE / EXTENT_SIZE)
+
+// Default threshold, strings longer than it are stored as large strings
+#define LARGE_STRING_THRESHOLD  128
+
+// The longest string can be stored, including '\0'
+#define MAX_STRING_LENGTH   (STORAGE_SIZE > LARGE_STORAGE_SIZE ? \
+                                STORAGE_SIZE : LARGE_STORAGE_SIZE)
+
+// The number of characters in shortest string is 2, including '\0',
+// and each large string takes at least one extent
+#define MAX_STRING_COUNT    (STORAGE_SIZE / 2 + EXTENT_COUNT)
+
+// String id is a slot with its generation, slot is reused by later
+// strings with the next generation. Ids fit 32 bits with shard bits
+#define SLOT_BITS           10
+#define GENERATION_BITS     18
+#define INVALID_SLOT        UINT32_MAX
+
+// Compressed string starts with its length and code size
+#define COMPRESSED_HEADER_SIZE  2
+
+// Characters of each chunk keeping decompressed strings for reading
+#define PIN_CHUNK_SIZE      MAX_STRING_LENGTH
+
+// Number of query results cached, and their max memory in bytes
+#define QUERY_CACHE_COUNT   32
+#define QUERY_CACHE_MEMORY  (64 * 1024)
+
+// Query types of cached results
+#define QUERY_TYPE_ALL      0
+#define QUERY_TYPE_FUZZY    1
+
+// Number of change events kept for consumers, must be power of 2
+#define CHANGE_RING_SIZE    1024
+
+// Characters of strings carried by change events, must be power of 2
+// and not less than MAX_STRING_LENGTH
+#define CHANGE_ARENA_SIZE   (64 * 1024)
+
+// Each thread selects its own database
+#ifdef _MSC_VER
+#define THREAD_LOCAL        __declspec(thread)
+#else
+#define THREAD_LOCAL        _Thread_local
+#endif
+
+// Memory ordering of change ring, which is read without lock. Acquire
+// and release work on size_t, relaxed accesses work on any field that
+// is written while being read, so no access is torn or a data race.
+// Interlocked functions are full barriers, aligned volatile accesses
+// are atomic on MSVC
+#ifdef _MSC_VER
+#define LOAD_ACQUIRE(lpValue)           \
+    ((size_t)InterlockedCompareExchangePointer((void *volatile *)(lpValue), NULL, NULL))
+#define STORE_RELEASE(lpValue, nValue)  \
+    ((void)InterlockedExchangePointer((void *volatile *)(lpValue), (void *)(nValue)))
+#define LOAD_RELAXED(Type, lpValue)             (*(volatile const Type *)(lpValue))
+#define STORE_RELAXED(Type, lpValue, Value)     (*(volatile Type *)(lpValue) = (Value))
+#define MEMORY_FENCE()                  MemoryBarrier()
+#else
+#define LOAD_ACQUIRE(lpValue)           __atomic_load_n((lpValue), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(lpValue, nValue)  __atomic_store_n((lpValue), (nValue), __ATOMIC_RELEASE)
+#define LOAD_RELAXED(Type, lpValue)             __atomic_load_n((lpValue), __ATOMIC_RELAXED)
+#define STORE_RELAXED(Type, lpValue, Value)     __atomic_store_n((lpValue), (Value), __ATOMIC_RELAXED)
+#define MEMORY_FENCE()                  __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
 
 /*
-    Storage index to locate a string in database
+    Storage index to locate a string in database.
+    Offset and length are 32-bit so that an entry takes 8 bytes
+    instead of 16, and table scans touch half as many cache lines.
+    Offsets from STORAGE_SIZE on locate strings in large storage, so 
+    all large strings are sorted behind small strings in table
 */
 typedef struct _Index
 {
-    wchar_t *lpData;    // String pointer
-    size_t nLength;     // Number of characters in string, including '\0'
+    uint32_t nOffset;           // String offset in storage
+    uint32_t nLength : 31;      // Number of characters in storage, including '\0'
+    uint32_t bCompressed : 1;   // Whether string is compressed by dictionary
 } Index;
 
+/*
+    File mapped to memory
+*/
+typedef struct _MappedFile
+{
+    const uint8_t *lpData;  // File content, NULL if file is empty
+    size_t nSize;           // File size in bytes
+#ifdef _WIN32
+    void *hFile;            // File handle
+    void *hMapping;         // File mapping handle
+#endif
+} MappedFile;
+
+/*
+    Cached query result, valid while database version is not changed
+*/
+typedef struct _QueryCacheEntry
+{
+    int nType;              // Query type
+    int nMode;              // Query mode
+    size_t nVersion;        // Database version of result
+    const wchar_t *lpKey;   // The string queried
+    uint32_t *lpIndexes;    // Matched string indexes, key is stored behind
+    size_t nMatchCount;     // The matched strings count
+    size_t nMemory;         // Bytes allocated for indexes and key
+    uint32_t nTouch;        // Last touch time, 0 if entry is empty
+} QueryCacheEntry;
+
+/*
+    Slot of change ring. Lock is odd while the event is written, and is
+    twice the event sequence when it is done, so readers can tell a torn 
+    or overwritten event
+*/
+typedef struct _ChangeSlot
+{
+    size_t nLock;
+    ChangeEvent Event;
+} ChangeSlot;
+
+/*
+    Chunk of decompressed strings for reading. Chunks are never moved,
+    so strings in them stay in place until chunks are reused
+*/
+typedef struct _PinChunk
+{
+    struct _PinChunk *lpNext;       // The next chunk, NULL if it is the last
+    size_t nUsedSize;               // Number of characters used
+    wchar_t szData[PIN_CHUNK_SIZE]; // Decompressed strings
+} PinChunk;
+
+/*
+    All states of a database, a thread works on the database it selects
+*/
+struct _Database
+{
+    // String storage
+    wchar_t szStorage[STORAGE_SIZE];
+    size_t nUsedSize;
+
+    // Large string storage, allocated by extents
+    wchar_t szLargeStorage[LARGE_STORAGE_SIZE];
+    bool bExtentUsed[EXTENT_COUNT];
+    size_t nUsedExtents;
+    size_t nLargeThreshold;
+
+    // String index table, to locate all strings in storage
+    Index IdxTab[MAX_STRING_COUNT];
+    size_t nCount;
+    size_t nSmallCount;         // Small strings are in front of table
+
+    // Stable ids of strings, slots are located by slot map as
+    // indexes are shifted
+    uint32_t nSlotTab[MAX_STRING_COUNT];        // Slot of each index
+    uint32_t nSlotIndex[MAX_STRING_COUNT];      // Index of each slot, or INVALID_SLOT
+    uint32_t nSlotGeneration[MAX_STRING_COUNT]; // Increased when slot is released
+    uint32_t nFreeSlots[MAX_STRING_COUNT];
+    size_t nFreeSlotCount;
+    size_t nSlotCount;          // Slots ever assigned
+
+    // Record string query results
+    QueryRecord QueryRecords[MAX_STRING_COUNT];
+
+    // Cached query results, invalid once database version is changed
+    QueryCacheEntry QueryCache[QUERY_CACHE_COUNT];
+    size_t nQueryCacheMemory;
+    uint32_t nQueryCacheClock;
+    size_t nVersion;
+
+    // Build spliced strings which can not be altered on the same place
+    wchar_t szSpliceBuffer[MAX_STRING_LENGTH];
+
+    // Hashes of case folded and normalized strings, to query
+    // without folding every string
+    uint32_t nCaseKeyTab[MAX_STRING_COUNT];
+    uint32_t nNormKeyTab[MAX_STRING_COUNT];
+    wchar_t szFoldQuery[MAX_STRING_LENGTH];
+    wchar_t szFoldBuffer[MAX_STRING_LENGTH];
+
+    // Touch time of strings, to find cold strings
+    uint32_t nTouchTab[MAX_STRING_COUNT];
+    uint32_t nClock;
+
+    // Shared dictionary to compress cold strings
+    SymbolTable Dictionary;
+    size_t nCompressedCount;
+    uint8_t CodeBuffer[STORAGE_SIZE * sizeof(wchar_t)];
+    uint8_t QueryCode[STORAGE_SIZE * sizeof(wchar_t)];
+    CodeMatcher Matcher;        // Substring searched in compressed strings
+    wchar_t szThawBuffer[MAX_STRING_LENGTH];
+
+    // Decompressed strings for reading, kept until database version
+    // is changed, so their pointers are as stable as uncompressed ones
+    wchar_t *lpPinTab[MAX_STRING_COUNT];    // Decompressed string of each index
+    PinChunk *lpPinChunks;
+    PinChunk *lpPinChunk;                   // The chunk being filled
+    size_t nPinVersion;                     // Database version of pinned strings
+
+    // Frequent strings, n-grams and distinct count
+    SketchSet Sketches;
+
+    // Change events, written by the thread changing database only
+    ChangeSlot ChangeRing[CHANGE_RING_SIZE];
+    size_t nChangeHead;         // Sequence of the latest event
+    bool bChangesPaused;        // Steps of a change are not published
+    size_t nPausedRelocate;     // First string relocated while paused, or SIZE_MAX
+
+    // Strings of change events, written in a ring without '\0'
+    wchar_t szChangeArena[CHANGE_ARENA_SIZE];
+    size_t nArenaHead;          // Position after the latest string, never wrapped
+};
+
+/*
+ - Description
+    Resolve the string pointer of an index
+ - Input
+    lpIndex: The index to resolve
+ - Return
+    The string pointer in storage
+*/
+static wchar_t *_IndexData(const Index *lpIndex);
+
+/*
+ - Description
+    Get the number of characters in string of an index, 
+    which differs from the occupied size if it is compressed
+ - Input
+    lpIndex: The index of string
+ - Return
+    Number of characters in string, including '\0'
+*/
+static size_t _ItemLength(const Index *lpIndex);
+
+/*
+ - Description
+    Update the touch time of string, to find cold strings
+ - Input
+    nIndex: The index of string
+*/
+static void TouchItem(size_t nIndex);
+
+/*
+ - Description
+    Compute the folded keys of string
+ - Input
+    nIndex: The index of string
+    lpString: The string, uncompressed
+    nLength: Number of characters in string, including '\0'
+*/
+static void SetFoldKeys(size_t nIndex, const wchar_t *lpString, size_t nLength);
+
+/*
+ - Description
+    Uncount string of an index in sketches, before it is released or altered
+ - Input
+    lpIndex: The index of string
+*/
+static void RemoveItemFromSketches(const Index *lpIndex);
+
+/*
+ - Description
+    Fold string of an index to buffer, with '\0'
+ - Input
+    lpIndex: The index of string
+    bNormalize: Whether to normalize besides case folding
+ - Output
+    lpOutput: The folded string
+ - Return
+    Number of characters folded, not including '\0'
+*/
+static size_t FoldItem(const Index *lpIndex, bool bNormalize, wchar_t *lpOutput);
+
+/*
+ - Description
+    Compress string in place by shared dictionary
+ - Input
+    nIndex: The index of string
+ - Return
+    true if compressed, or false if it saves no space
+*/
+static bool CompressItem(size_t nIndex);
+
+/*
+ - Description
+    Decompress string of an index
+ - Input
+    lpIndex: The index of compressed string
+ - Output
+    lpOutput: The decompressed string, with '\0'
+*/
+static void DecodeItem(const Index *lpIndex, wchar_t *lpOutput);
+
+/*
+ - Description
+    Get decompressed string of an index, decompress it if it is not 
+    pinned since database version is changed
+ - Input
+    lpIndex: The index of compressed string
+ - Return
+    The decompressed string pointer, or NULL if out of memory
+*/
+static wchar_t *FetchPinnedItem(const Index *lpIndex);
+
+/*
+ - Description
+    Reserve space of pinned strings, reuse all chunks once database
+    version is changed
+ - Input
+    nLength: Number of characters to reserve
+ - Return
+    The reserved space, or NULL if out of memory
+*/
+static wchar_t *ReservePinSpace(size_t nLength);
+
 /*
  - Description
     Get string by index
@@ -34,6 +345,17 @@ typedef struct _Index
 */
 static wchar_t *_GetItem(size_t nIndex, size_t *lpLength);
 
+/*
+ - Description
+    Get the number of characters a string can occupy without moving,
+    which is its length plus the free gap behind it
+ - Input
+    nIndex: The index of string
+ - Return
+    The capacity of string, including '\0'
+*/
+static size_t _GetItemCapacity(size_t nIndex);
+
 /*
  - Description
     Lookup request free size in storage
@@ -47,14 +369,95 @@ static wchar_t *_GetItem(size_t nIndex, size_t *lpLength);
 */
 static wchar_t *LookupFreeSpace(size_t nMinSize, bool AllowDefrag, size_t *lpIndex);
 
+/*
+ - Description
+    Find continuous free extents in large storage
+ - Input
+    nExtentCount: Number of extents requested
+    nSkipFirst: The first extent treated as free, for the space to be released
+    nSkipCount: Number of extents treated as free, it can be 0
+ - Return
+    The first extent of free extents, or EXTENT_COUNT if not found
+*/
+static size_t FindFreeExtents(size_t nExtentCount, size_t nSkipFirst, size_t nSkipCount);
+
+/*
+ - Description
+    Lookup request free size in large storage
+ - Input
+    nMinSize: Minmum request size
+ - Output
+    lpIndex: Space index in table
+ - Return
+    The free space pointer, or NULL
+*/
+static wchar_t *LookupLargeSpace(size_t nMinSize, size_t *lpIndex);
+
+/*
+ - Description
+    Mark extents of a large string as used or free
+ - Input
+    nOffset: The string offset
+    nLength: Number of characters that extents cover
+    bUsed: Whether the extents are used
+*/
+static void MarkExtents(size_t nOffset, size_t nLength, bool bUsed);
+
+/*
+ - Description
+    Check whether a string can be stored after another string is released
+ - Input
+    nLength: Number of characters in string, including '\0'
+    nReleaseIndex: The index of string to release
+ - Return
+    true if the string can be stored, or false
+*/
+static bool CanStoreAfterRelease(size_t nLength, size_t nReleaseIndex);
+
+/*
+ - Description
+    Get the string id of a slot
+ - Input
+    nSlot: The slot
+ - Return
+    The id of slot with its current generation
+*/
+static size_t SlotItemId(uint32_t nSlot);
+
+/*
+ - Description
+    Assign a free slot to a new string
+ - Return
+    The slot
+*/
+static uint32_t AcquireSlot();
+
+/*
+ - Description
+    Release the slot of a deleted string, ids of the slot are invalid
+ - Input
+    nSlot: The slot
+*/
+static void ReleaseSlot(uint32_t nSlot);
+
+/*
+ - Description
+    Relocate slots of shifted indexes
+ - Input
+    nBegin: The first index shifted
+    nEnd: The index after the last one shifted
+*/
+static void UpdateSlotMap(size_t nBegin, size_t nEnd);
+
 /*
  - Description
     Insert a new string index to table
  - Input
     nLocation: Location to insert
     lpString: Releated string
+    nLength: Number of characters in string, including '\0'
 */
-static void InsertIndex(size_t nLocation, wchar_t *lpString);
+static void InsertIndex(size_t nLocation, wchar_t *lpString, size_t nLength);
 
 /*
  - Description
@@ -69,6 +472,87 @@ static void DeleteIndex(size_t nLocation);
 */
 static void ClearQueryRecords();
 
+/*
+ - Description
+    Point query records to their strings by indexes. Compressed strings are
+    pinned, so that records of one query never overwrite each other
+ - Input
+    nMatchCount: The matched strings count
+*/
+static void ResolveRecords(size_t nMatchCount);
+
+/*
+    Change database version, cached query results become invalid
+*/
+static void UpdateVersion();
+
+/*
+ - Description
+    Copy an event field by field with relaxed atomic accesses, as the
+    event in ring may be written while being read
+ - Input
+    lpSource: The event to copy
+ - Output
+    lpDest: The copied event
+*/
+static void CopyEvent(ChangeEvent *lpDest, const ChangeEvent *lpSource);
+
+/*
+ - Description
+    Copy characters to or from change arena with relaxed atomic accesses,
+    as arena may be written while being read
+ - Input
+    lpSource: The characters to copy
+    nLength: Number of characters
+ - Output
+    lpDest: The copied characters
+*/
+static void CopyArenaChars(wchar_t *lpDest, const wchar_t *lpSource, size_t nLength);
+
+/*
+ - Description
+    Publish a change event to change ring, unless changes are paused
+ - Input
+    lpChange: The change, sequence, offset and data position are filled
+    lpString: The string stored or altered. It can be NULL
+*/
+static void PublishChange(const ChangeEvent *lpChange, const wchar_t *lpString);
+
+/*
+ - Description
+    Lookup cached query result, and fill query records by it
+ - Input
+    nType: The query type
+    nMode: The query mode
+    lpString: The string queried
+ - Output
+    lpMatchCount: The matched strings count
+ - Return
+    true if result is cached, or false
+*/
+static bool LookupQueryCache(int nType, int nMode,
+    const wchar_t *lpString, size_t *lpMatchCount);
+
+/*
+ - Description
+    Cache query result in query records, the least recently used 
+    results are dropped when the cache is full
+ - Input
+    nType: The query type
+    nMode: The query mode
+    lpString: The string queried
+    nMatchCount: The matched strings count
+*/
+static void SaveQueryCache(int nType, int nMode, const wchar_t *lpString, size_t nMatchCount);
+
+/*
+ - Description
+    Drop a cached query result
+ - Input
+    lpEntry: The cached result
+*/
+static void DropQueryCache(QueryCacheEntry *lpEntry);
+
 /*
  - Description
     Query string by index
@@ -86,14 +570,62 @@ static wchar_t *_QueryByIndex(size_t nIndex, size_t *lpLength);
     Query next matched string by content
  - Input
     lpString: The string to query
+    nMode: The query mode
     nBeginIndex: The index of beginning to search
  - Output
     lpMatchIndex: The matched string index. It can be NULL
  - Return
     The next matched string pointer, or NULL
 */
-static wchar_t *_QueryNextByContent(
-    const wchar_t *lpString, size_t nBeginIndex, size_t *lpMatchIndex);
+static wchar_t *_QueryNextByContent(const wchar_t *lpString, 
+    int nMode, size_t nBeginIndex, size_t *lpMatchIndex);
+
+/*
+ - Description
+    Query next string which is equal to string after folding, 
+    only strings with the same folded key are compared
+ - Input
+    lpString: The string to query
+    bNormalize: Whether to normalize besides case folding
+    nBeginIndex: The index of beginning to search
+ - Output
+    lpMatchIndex: The matched string index. It can be NULL
+ - Return
+    The next matched string pointer, or NULL
+*/
+static wchar_t *_QueryNextByFoldedKey(const wchar_t *lpString,
+    bool bNormalize, size_t nBeginIndex, size_t *lpMatchIndex);
+
+/*
+ - Description
+    Map a file to memory for reading
+ - Input
+    lpFileName: The file name
+ - Output
+    lpFile: The mapped file
+ - Return
+    true if successful, or false
+*/
+static bool MapFile(const wchar_t *lpFileName, MappedFile *lpFile);
+
+/*
+ - Description
+    Unmap a file mapped by MapFile
+ - Input
+    lpFile: The mapped file
+*/
+static void UnmapFile(MappedFile *lpFile);
+
+/*
+ - Description
+    Count '0'~'9', 'A'~'Z' and 'a'~'z' in characters
+ - Input
+    lpString: The characters to count
+    nLength: Number of characters
+ - Output
+    lpCounts: The counts, added to their old values
+*/
+static void CountChars(const wchar_t *lpString, size_t nLength, size_t *lpCounts);
 
 /*
  - Description
@@ -101,5 +633,6 @@ static wchar_t *_QueryNextByContent(
  - Input
     lpDest: The dest buffer
     lpSrc: The source string
+    nLength: Number of characters to move, including '\0'
 */
-static void MoveString(wchar_t *lpDest, wchar_t *lpSrc);
\ No newline at end of file
+static void MoveString(wchar_t *lpDest, wchar_t *lpSrc, size_t nLength);
\ No newline at end of file
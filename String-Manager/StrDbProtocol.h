@@ -0,0 +1,178 @@
+/******************************************************
+ - FileName
+    StrDbProtocol.h
+ - Description
+    Binary protocol between string database server
+    and its clients. All integers are little endian,
+    strings are UTF-8 without '\0'
+
+    Request:  [Size:4][Id:4][Opcode:1][Payload]
+    Response: [Size:4][Id:4][Status:1][Payload]
+
+    Size counts the bytes behind itself. Clients can
+    send requests without waiting for responses, the
+    responses are sent back in the same order
+*******************************************************/
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEFAULT_SOCKET_PATH     "/tmp/strdb.sock"
+
+// Bytes of frame header, including size field
+#define FRAME_HEADER_SIZE       9
+
+// Max bytes of a frame behind size field
+#define MAX_FRAME_SIZE          (1024 * 1024)
+
+// Max handles returned by a query
+#define MAX_QUERY_HANDLES       1024
+
+// Max change events returned by a request
+#define MAX_CHANGE_EVENTS       32
+
+/*
+    Opcodes and their payloads, strings to store or alter to
+    must not be empty
+*/
+#define OP_STORE            1   // Request: String          Response: Handle:8
+#define OP_QUERY_HANDLE     2   // Request: Handle:8        Response: String
+#define OP_QUERY_ALL        3   // Request: String          Response: Count:4, Handle:8 * n
+#define OP_FUZZY_QUERY      4   // Request: String          Response: Count:4, Handle:8 * n
+#define OP_DELETE_HANDLE    5   // Request: Handle:8        Response: None
+#define OP_DELETE_ALL       6   // Request: String          Response: Count:4
+#define OP_ALTER_HANDLE     7   // Request: Handle:8 String Response: Handle:8
+#define OP_STATISTIC        8   // Request: None            Response: Total:8, Count:8 * 62
+#define OP_READ_CHANGES     9   // Request: Shard:1 Cursor:8 Response: Count:4, Event * n
+#define OP_SNAPSHOT         10  // Request: Shard:1         Response: Sequence:8, Count:4,
+                                //                          (Handle:8, Size:4, String) * n
+
+/*
+    Change event in response, handles are 0xFFFFFFFFFFFFFFFF if there is
+    none, and Size is the bytes of string stored or altered, 0 if none
+
+    [Sequence:8][Type:1][Index:4][Handle:8][PreviousIndex:4][PreviousHandle:8]
+    [Size:4][String]
+
+    Changes of a shard are read from the sequence of its snapshot, and
+    its snapshot is taken again if the request fails, as events after
+    cursor are overwritten
+*/
+#define CHANGE_HEADER_SIZE  37
+
+/*
+    Frame parsing results
+*/
+#define FRAME_COMPLETE      0   // A whole frame is received
+#define FRAME_PARTIAL       1   // More bytes are needed
+#define FRAME_INVALID       2   // Frame size is out of range, the connection
+                                // can not be parsed any more
+
+/*
+    Response status
+*/
+#define STATUS_OK           0   // Successful
+#define STATUS_FAILED       1   // Not found or no space
+#define STATUS_BAD_REQUEST  2   // Malformed request
+
+/*
+    Write a 32-bit integer
+*/
+static inline void PutUint32(uint8_t *lpBuffer, uint32_t nValue)
+{
+    for (size_t i = 0; i != 4; ++i)
+    {
+        lpBuffer[i] = (uint8_t)(nValue >> (i * 8));
+    }
+}
+
+/*
+    Write a 64-bit integer
+*/
+static inline void PutUint64(uint8_t *lpBuffer, uint64_t nValue)
+{
+    for (size_t i = 0; i != 8; ++i)
+    {
+        lpBuffer[i] = (uint8_t)(nValue >> (i * 8));
+    }
+}
+
+/*
+    Read a 32-bit integer
+*/
+static inline uint32_t GetUint32(const uint8_t *lpBuffer)
+{
+    uint32_t nValue = 0;
+    for (size_t i = 0; i != 4; ++i)
+    {
+        nValue |= (uint32_t)lpBuffer[i] << (i * 8);
+    }
+
+    return nValue;
+}
+
+/*
+    Read a 64-bit integer
+*/
+static inline uint64_t GetUint64(const uint8_t *lpBuffer)
+{
+    uint64_t nValue = 0;
+    for (size_t i = 0; i != 8; ++i)
+    {
+        nValue |= (uint64_t)lpBuffer[i] << (i * 8);
+    }
+
+    return nValue;
+}
+
+/*
+ - Description
+    Write frame header
+ - Input
+    nId: The request id
+    nCode: Opcode of request, or status of response
+    nPayloadSize: Bytes of payload behind header
+ - Output
+    lpBuffer: The header written
+ - Return
+    Bytes of header
+*/
+static inline size_t PutFrameHeader(uint8_t *lpBuffer, uint32_t nId, uint8_t nCode, size_t nPayloadSize)
+{
+    PutUint32(lpBuffer, (uint32_t)(FRAME_HEADER_SIZE - 4 + nPayloadSize));
+    PutUint32(&lpBuffer[4], nId);
+    lpBuffer[8] = nCode;
+    return FRAME_HEADER_SIZE;
+}
+
+/*
+ - Description
+    Parse the frame at the beginning of received bytes
+ - Input
+    lpData: The received bytes
+    nSize: Number of bytes received
+ - Output
+    lpFrameSize: Bytes of frame behind size field, if it is complete
+ - Return
+    FRAME_COMPLETE, FRAME_PARTIAL or FRAME_INVALID
+*/
+static inline int ParseFrame(const uint8_t *lpData, size_t nSize, size_t *lpFrameSize)
+{
+    if (nSize < 4)
+    {
+        return FRAME_PARTIAL;
+    }
+
+    size_t nFrameSize = GetUint32(lpData);
+    if (nFrameSize < FRAME_HEADER_SIZE - 4 || nFrameSize > MAX_FRAME_SIZE)
+    {
+        return FRAME_INVALID;
+    }
+    else if (nSize - 4 < nFrameSize)
+    {
+        return FRAME_PARTIAL;
+    }
+
+    *lpFrameSize = nFrameSize;
+    return FRAME_COMPLETE;
+}
@@ -0,0 +1,718 @@
+/******************************************************
+ - FileName
+    StrDbServer.c
+ - Description
+    Local string database server on Unix domain socket.
+    Connections are spread over worker threads, each
+    worker serves its connections by its own epoll,
+    and the shared store is the sharded database.
+    Linux only, for epoll
+ - Usage
+    StrDbServer [SocketPath] [WorkerCount]
+*******************************************************/
+#include "StrDbProtocol.h"
+#include "StrDbShard.h"
+#include "StrDbCodec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <wchar.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define DEFAULT_WORKER_COUNT    4
+#define MAX_WORKER_COUNT        64
+#define MAX_EVENTS              64
+#define READ_SIZE               (64 * 1024)
+
+// Min array size to store '0'~'9', 'a'~'z' and 'A'~'Z' counts
+#define STAT_SIZE               62
+
+// Longest string in request, including '\0'
+#define MAX_STRING_CHARS        4096
+
+// Reserved bytes for each response
+#define MAX_RESPONSE_SIZE       (FRAME_HEADER_SIZE + MAX_STRING_CHARS * 4)
+
+// Requests are not read or executed while this many bytes of
+// responses are not sent, so a client not reading can not grow output
+#define MAX_PENDING_OUTPUT      (1024 * 1024)
+
+// Pause of accepting when no descriptor can be opened, in microseconds
+#define ACCEPT_BACKOFF          10000
+
+/*
+    Growable byte buffer
+*/
+typedef struct _Buffer
+{
+    uint8_t *lpData;
+    size_t nSize;           // Bytes used
+    size_t nCapacity;       // Bytes allocated
+} Buffer;
+
+/*
+    Client connection, only touched by the worker it belongs to
+*/
+typedef struct _Connection
+{
+    int nSocket;
+    Buffer Input;           // Received bytes not processed yet
+    Buffer Output;          // Responses not sent yet
+    size_t nSent;           // Bytes of output already sent
+    uint32_t nEvents;       // Events waited in epoll
+} Connection;
+
+/*
+    Worker thread with its own epoll
+*/
+typedef struct _Worker
+{
+    pthread_t Thread;
+    int nEpoll;
+} Worker;
+
+static Worker g_Workers[MAX_WORKER_COUNT];
+
+/*
+    Make sure buffer has space for more bytes
+*/
+static bool ReserveBuffer(Buffer *lpBuffer, size_t nMore)
+{
+    assert(lpBuffer != NULL);
+
+    if (lpBuffer->nSize + nMore <= lpBuffer->nCapacity)
+    {
+        return true;
+    }
+
+    size_t nCapacity = (lpBuffer->nCapacity != 0) ? lpBuffer->nCapacity : READ_SIZE;
+    while (nCapacity < lpBuffer->nSize + nMore)
+    {
+        nCapacity *= 2;
+    }
+
+    uint8_t *lpData = realloc(lpBuffer->lpData, nCapacity);
+    if (lpData == NULL)
+    {
+        return false;
+    }
+
+    lpBuffer->lpData = lpData;
+    lpBuffer->nCapacity = nCapacity;
+    return true;
+}
+
+/*
+    Close connection and free its buffers
+*/
+static void CloseConnection(Connection *lpConnection)
+{
+    assert(lpConnection != NULL);
+
+    // Closing the socket removes it from epoll
+    close(lpConnection->nSocket);
+    free(lpConnection->Input.lpData);
+    free(lpConnection->Output.lpData);
+    free(lpConnection);
+}
+
+/*
+    Decode string payload, return false if it is too long
+*/
+static bool DecodePayload(const uint8_t *lpPayload, size_t nSize, wchar_t *lpString)
+{
+    size_t nLength = DecodeUtf8(lpPayload, nSize, lpString, MAX_STRING_CHARS - 1);
+    if (nLength == SIZE_MAX)
+    {
+        return false;
+    }
+
+    lpString[nLength] = L'\0';
+    return true;
+}
+
+/*
+    Write handles of query result as response payload
+*/
+static size_t PutHandles(uint8_t *lpPayload, const ShardHandle *lpHandles, size_t nMatchCount)
+{
+    size_t nCount = (nMatchCount < MAX_QUERY_HANDLES) ? nMatchCount : MAX_QUERY_HANDLES;
+    PutUint32(lpPayload, (uint32_t)nCount);
+    for (size_t i = 0; i != nCount; ++i)
+    {
+        PutUint64(&lpPayload[4 + i * 8], lpHandles[i]);
+    }
+
+    return 4 + nCount * 8;
+}
+
+/*
+    Write a size value as 64-bit, SIZE_MAX is kept as all ones
+*/
+static void PutSize(uint8_t *lpBuffer, size_t nValue)
+{
+    PutUint64(lpBuffer, (nValue != SIZE_MAX) ? (uint64_t)nValue : UINT64_MAX);
+}
+
+/*
+    Write change events of a shard behind the response header in
+    output, return payload size, or SIZE_MAX if no event can be read
+*/
+static size_t PutChanges(Buffer *lpOutput, size_t nShard, size_t nCursor)
+{
+    ChangeEvent Events[MAX_CHANGE_EVENTS];
+    size_t nCount = ShardReadChanges(nShard, nCursor, Events, MAX_CHANGE_EVENTS);
+    if (nCount == CHANGE_CURSOR_LOST)
+    {
+        return SIZE_MAX;
+    }
+
+    // Buffer may be moved as it grows, so payload is located every time
+    wchar_t szString[MAX_STRING_CHARS];
+    size_t nPayloadSize = 4, nWritten = 0;
+    for (; nWritten != nCount; ++nWritten)
+    {
+        const ChangeEvent *lpEvent = &Events[nWritten];
+        bool bData = (lpEvent->nType == CHANGE_STORE || lpEvent->nType == CHANGE_ALTER);
+        size_t nLength = (bData == true) ? lpEvent->nLength - 1 : 0;
+        if ((bData == true && ShardReadChangeData(nShard, lpEvent, szString) == false)
+            || ReserveBuffer(lpOutput, FRAME_HEADER_SIZE + nPayloadSize 
+                + CHANGE_HEADER_SIZE + nLength * 4) == false)
+        {
+            break;
+        }
+
+        uint8_t *lpEntry = &lpOutput->lpData[lpOutput->nSize + FRAME_HEADER_SIZE + nPayloadSize];
+        size_t nSize = EncodeUtf8(szString, nLength, &lpEntry[CHANGE_HEADER_SIZE], nLength * 4);
+        PutUint64(lpEntry, lpEvent->nSequence);
+        lpEntry[8] = (uint8_t)lpEvent->nType;
+        PutUint32(&lpEntry[9], (uint32_t)lpEvent->nIndex);
+        PutSize(&lpEntry[13], lpEvent->nId);
+        PutUint32(&lpEntry[21], (uint32_t)lpEvent->nPreviousIndex);
+        PutSize(&lpEntry[25], lpEvent->nPreviousId);
+        PutUint32(&lpEntry[33], (uint32_t)nSize);
+        nPayloadSize += CHANGE_HEADER_SIZE + nSize;
+    }
+
+    if (nWritten == 0 && nCount != 0)
+    {
+        return SIZE_MAX;
+    }
+
+    PutUint32(&lpOutput->lpData[lpOutput->nSize + FRAME_HEADER_SIZE], (uint32_t)nWritten);
+    return nPayloadSize;
+}
+
+/*
+    Write snapshot of a shard behind the response header in output,
+    return payload size, or SIZE_MAX if out of memory
+*/
+static size_t PutSnapshot(Buffer *lpOutput, size_t nShard)
+{
+    Snapshot *lpSnapshot = ShardTakeSnapshot(nShard);
+    if (lpSnapshot == NULL)
+    {
+        return SIZE_MAX;
+    }
+
+    size_t nMaxSize = 12;
+    for (size_t i = 0; i != lpSnapshot->nCount; ++i)
+    {
+        nMaxSize += 12 + wcslen(lpSnapshot->lpStrings[i]) * 4;
+    }
+
+    if (ReserveBuffer(lpOutput, FRAME_HEADER_SIZE + nMaxSize) == false)
+    {
+        FreeSnapshot(lpSnapshot);
+        return SIZE_MAX;
+    }
+
+    uint8_t *lpPayload = &lpOutput->lpData[lpOutput->nSize + FRAME_HEADER_SIZE];
+    PutUint64(lpPayload, lpSnapshot->nSequence);
+    PutUint32(&lpPayload[8], (uint32_t)lpSnapshot->nCount);
+    size_t nPayloadSize = 12;
+    for (size_t i = 0; i != lpSnapshot->nCount; ++i)
+    {
+        size_t nLength = wcslen(lpSnapshot->lpStrings[i]);
+        uint8_t *lpEntry = &lpPayload[nPayloadSize];
+        size_t nSize = EncodeUtf8(lpSnapshot->lpStrings[i], nLength, &lpEntry[12], nLength * 4);
+        PutSize(lpEntry, lpSnapshot->lpIds[i]);
+        PutUint32(&lpEntry[8], (uint32_t)nSize);
+        nPayloadSize += 12 + nSize;
+    }
+
+    FreeSnapshot(lpSnapshot);
+    return nPayloadSize;
+}
+
+/*
+    Execute a request and append its response to output
+*/
+static bool HandleRequest(Connection *lpConnection, const uint8_t *lpFrame, size_t nFrameSize)
+{
+    assert(nFrameSize >= FRAME_HEADER_SIZE - 4);
+
+    Buffer *lpOutput = &lpConnection->Output;
+    if (ReserveBuffer(lpOutput, MAX_RESPONSE_SIZE) == false)
+    {
+        return false;
+    }
+
+    uint32_t nId = GetUint32(lpFrame);
+    uint8_t nOpcode = lpFrame[4];
+    const uint8_t *lpRequest = &lpFrame[5];
+    size_t nRequestSize = nFrameSize - 5;
+
+    uint8_t *lpResponse = &lpOutput->lpData[lpOutput->nSize];
+    uint8_t *lpPayload = &lpResponse[FRAME_HEADER_SIZE];
+    uint8_t nStatus = STATUS_OK;
+    size_t nPayloadSize = 0;
+
+    wchar_t szString[MAX_STRING_CHARS];
+    ShardHandle Handles[MAX_QUERY_HANDLES];
+    ShardHandle hItem = 0;
+    size_t nCount = 0;
+
+    switch (nOpcode)
+    {
+    case OP_STORE:
+        if (nRequestSize == 0 || DecodePayload(lpRequest, nRequestSize, szString) == false)
+        {
+            nStatus = STATUS_BAD_REQUEST;
+        }
+        else if (ShardStore(szString, &hItem) == false)
+        {
+            nStatus = STATUS_FAILED;
+        }
+        else
+        {
+            PutUint64(lpPayload, hItem);
+            nPayloadSize = 8;
+        }
+        break;
+
+    case OP_QUERY_HANDLE:
+        if (nRequestSize != 8)
+        {
+            nStatus = STATUS_BAD_REQUEST;
+            break;
+        }
+
+        nCount = ShardQueryByHandle((ShardHandle)GetUint64(lpRequest), szString, MAX_STRING_CHARS);
+        if (nCount == 0 || nCount > MAX_STRING_CHARS)
+        {
+            nStatus = STATUS_FAILED;
+        }
+        else
+        {
+            nPayloadSize = EncodeUtf8(szString, nCount - 1, lpPayload, MAX_STRING_CHARS * 4);
+        }
+        break;
+
+    case OP_QUERY_ALL:
+    case OP_FUZZY_QUERY:
+        if (DecodePayload(lpRequest, nRequestSize, szString) == false)
+        {
+            nStatus = STATUS_BAD_REQUEST;
+            break;
+        }
+
+        nCount = (nOpcode == OP_QUERY_ALL) ?
+            ShardQueryAllByContent(szString, Handles, MAX_QUERY_HANDLES) :
+            ShardFuzzyQueryAllByContent(szString, Handles, MAX_QUERY_HANDLES);
+        nPayloadSize = PutHandles(lpPayload, Handles, nCount);
+        break;
+
+    case OP_DELETE_HANDLE:
+        if (nRequestSize != 8)
+        {
+            nStatus = STATUS_BAD_REQUEST;
+        }
+        else if (ShardDeleteByHandle((ShardHandle)GetUint64(lpRequest)) == false)
+        {
+            nStatus = STATUS_FAILED;
+        }
+        break;
+
+    case OP_DELETE_ALL:
+        if (DecodePayload(lpRequest, nRequestSize, szString) == false)
+        {
+            nStatus = STATUS_BAD_REQUEST;
+            break;
+        }
+
+        PutUint32(lpPayload, (uint32_t)ShardDeleteAllByContent(szString));
+        nPayloadSize = 4;
+        break;
+
+    case OP_ALTER_HANDLE:
+        if (nRequestSize <= 8 || DecodePayload(&lpRequest[8], nRequestSize - 8, szString) == false)
+        {
+            nStatus = STATUS_BAD_REQUEST;
+        }
+        else if (ShardAlterByHandle((ShardHandle)GetUint64(lpRequest), szString, &hItem) == false)
+        {
+            nStatus = STATUS_FAILED;
+        }
+        else
+        {
+            PutUint64(lpPayload, hItem);
+            nPayloadSize = 8;
+        }
+        break;
+
+    case OP_STATISTIC:
+    {
+        size_t Counts[STAT_SIZE] = { 0 };
+        size_t nTotal = 0;
+        ShardStatistic(Counts, STAT_SIZE, &nTotal);
+        PutUint64(lpPayload, nTotal);
+        for (size_t i = 0; i != STAT_SIZE; ++i)
+        {
+            PutUint64(&lpPayload[8 + i * 8], Counts[i]);
+        }
+
+        nPayloadSize = 8 + STAT_SIZE * 8;
+        break;
+    }
+
+    case OP_READ_CHANGES:
+    case OP_SNAPSHOT:
+        if (nRequestSize != ((nOpcode == OP_READ_CHANGES) ? 9 : 1) || lpRequest[0] >= SHARD_COUNT)
+        {
+            nStatus = STATUS_BAD_REQUEST;
+            break;
+        }
+
+        nPayloadSize = (nOpcode == OP_READ_CHANGES) ?
+            PutChanges(lpOutput, lpRequest[0], (size_t)GetUint64(&lpRequest[1])) :
+            PutSnapshot(lpOutput, lpRequest[0]);
+        if (nPayloadSize == SIZE_MAX)
+        {
+            nStatus = STATUS_FAILED;
+            nPayloadSize = 0;
+        }
+        break;
+
+    default:
+        nStatus = STATUS_BAD_REQUEST;
+        break;
+    }
+
+    // Output may be moved by responses reserving more
+    lpResponse = &lpOutput->lpData[lpOutput->nSize];
+    lpOutput->nSize += PutFrameHeader(lpResponse, nId, nStatus, nPayloadSize) + nPayloadSize;
+    return true;
+}
+
+/*
+    Check whether too many responses are not sent
+*/
+static bool IsOutputFull(const Connection *lpConnection)
+{
+    return lpConnection->Output.nSize - lpConnection->nSent >= MAX_PENDING_OUTPUT;
+}
+
+/*
+    Execute complete requests in input until output is full,
+    return false if input is malformed
+*/
+static bool HandleInput(Connection *lpConnection)
+{
+    Buffer *lpInput = &lpConnection->Input;
+    size_t nOffset = 0;
+    while (IsOutputFull(lpConnection) == false)
+    {
+        size_t nFrameSize = 0;
+        int nResult = ParseFrame(&lpInput->lpData[nOffset], lpInput->nSize - nOffset, &nFrameSize);
+        if (nResult == FRAME_INVALID)
+        {
+            return false;
+        }
+        else if (nResult == FRAME_PARTIAL)
+        {
+            // Wait for the rest of frame
+            break;
+        }
+
+        if (HandleRequest(lpConnection, &lpInput->lpData[nOffset + 4], nFrameSize) == false)
+        {
+            return false;
+        }
+
+        nOffset += 4 + nFrameSize;
+    }
+
+    // Keep the incomplete or held frames at the beginning
+    memmove(lpInput->lpData, &lpInput->lpData[nOffset], lpInput->nSize - nOffset);
+    lpInput->nSize -= nOffset;
+    return true;
+}
+
+/*
+    Send pending responses, wait for socket to be writable if it is full,
+    and stop waiting for requests while output is full
+*/
+static bool FlushOutput(Connection *lpConnection, int nEpoll)
+{
+    Buffer *lpOutput = &lpConnection->Output;
+    while (lpConnection->nSent != lpOutput->nSize)
+    {
+        ssize_t nSent = send(lpConnection->nSocket, &lpOutput->lpData[lpConnection->nSent],
+            lpOutput->nSize - lpConnection->nSent, MSG_NOSIGNAL);
+        if (nSent > 0)
+        {
+            lpConnection->nSent += (size_t)nSent;
+        }
+        else if (nSent == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (nSent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    bool bWaitWritable = (lpConnection->nSent != lpOutput->nSize);
+    if (bWaitWritable == false)
+    {
+        lpOutput->nSize = 0;
+        lpConnection->nSent = 0;
+    }
+
+    uint32_t nEvents = (IsOutputFull(lpConnection) ? 0 : EPOLLIN) | (bWaitWritable ? EPOLLOUT : 0);
+    if (nEvents != lpConnection->nEvents)
+    {
+        struct epoll_event Event = { 0 };
+        Event.events = nEvents;
+        Event.data.ptr = lpConnection;
+        if (epoll_ctl(nEpoll, EPOLL_CTL_MOD, lpConnection->nSocket, &Event) == -1)
+        {
+            return false;
+        }
+
+        lpConnection->nEvents = nEvents;
+    }
+
+    return true;
+}
+
+/*
+    Read all available bytes, execute requests and send responses in a batch
+*/
+static bool ServeConnection(Connection *lpConnection, int nEpoll)
+{
+    Buffer *lpInput = &lpConnection->Input;
+    while (IsOutputFull(lpConnection) == false)
+    {
+        if (ReserveBuffer(lpInput, READ_SIZE) == false)
+        {
+            return false;
+        }
+
+        ssize_t nRead = recv(lpConnection->nSocket,
+            &lpInput->lpData[lpInput->nSize], READ_SIZE, 0);
+        if (nRead > 0)
+        {
+            lpInput->nSize += (size_t)nRead;
+            if (HandleInput(lpConnection) == false)
+            {
+                return false;
+            }
+        }
+        else if (nRead == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (nRead == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        else
+        {
+            // Closed by client
+            return false;
+        }
+    }
+
+    return FlushOutput(lpConnection, nEpoll);
+}
+
+/*
+    Send pending responses, then execute requests held by full output
+*/
+static bool ResumeConnection(Connection *lpConnection, int nEpoll)
+{
+    if (FlushOutput(lpConnection, nEpoll) == false)
+    {
+        return false;
+    }
+    else if (IsOutputFull(lpConnection) == false && lpConnection->Input.nSize != 0)
+    {
+        return HandleInput(lpConnection) == true && FlushOutput(lpConnection, nEpoll) == true;
+    }
+
+    return true;
+}
+
+/*
+    Worker thread, serves connections added to its epoll
+*/
+static void *WorkerMain(void *lpParam)
+{
+    Worker *lpWorker = lpParam;
+    struct epoll_event Events[MAX_EVENTS];
+    while (true)
+    {
+        int nCount = epoll_wait(lpWorker->nEpoll, Events, MAX_EVENTS, -1);
+        for (int i = 0; i < nCount; ++i)
+        {
+            Connection *lpConnection = Events[i].data.ptr;
+            bool bResult = true;
+            if ((Events[i].events & (EPOLLERR | EPOLLHUP)) != 0)
+            {
+                bResult = false;
+            }
+            else if ((Events[i].events & EPOLLIN) != 0)
+            {
+                bResult = ServeConnection(lpConnection, lpWorker->nEpoll);
+            }
+            else if ((Events[i].events & EPOLLOUT) != 0)
+            {
+                bResult = ResumeConnection(lpConnection, lpWorker->nEpoll);
+            }
+
+            if (bResult == false)
+            {
+                CloseConnection(lpConnection);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/*
+    Accept a connection. Out of descriptors, the connection waiting is
+    accepted by the reserved descriptor and closed, so it is not
+    reported again at once and accept does not spin
+*/
+static int AcceptConnection(int nListen, int *lpReserve)
+{
+    int nSocket = accept(nListen, NULL, NULL);
+    if (nSocket == -1 && (errno == EMFILE || errno == ENFILE))
+    {
+        if (*lpReserve != -1)
+        {
+            close(*lpReserve);
+            int nRejected = accept(nListen, NULL, NULL);
+            if (nRejected != -1)
+            {
+                close(nRejected);
+            }
+
+            *lpReserve = open("/dev/null", O_RDONLY);
+        }
+
+        // Descriptors are not released by closing at once, wait a while
+        usleep(ACCEPT_BACKOFF);
+    }
+
+    return nSocket;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *lpSocketPath = (argc > 1) ? argv[1] : DEFAULT_SOCKET_PATH;
+    int nWorkerCount = (argc > 2) ? atoi(argv[2]) : DEFAULT_WORKER_COUNT;
+    if (nWorkerCount < 1 || nWorkerCount > MAX_WORKER_COUNT)
+    {
+        fprintf(stderr, "Worker count must be 1 ~ %d\n", MAX_WORKER_COUNT);
+        return EXIT_FAILURE;
+    }
+
+    struct sockaddr_un Address = { 0 };
+    Address.sun_family = AF_UNIX;
+    if (strlen(lpSocketPath) >= sizeof(Address.sun_path))
+    {
+        fprintf(stderr, "Socket path is too long\n");
+        return EXIT_FAILURE;
+    }
+
+    strcpy(Address.sun_path, lpSocketPath);
+    unlink(lpSocketPath);
+
+    int nListen = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (nListen == -1
+        || bind(nListen, (struct sockaddr *)&Address, sizeof(Address)) == -1
+        || listen(nListen, SOMAXCONN) == -1)
+    {
+        perror("Listen");
+        return EXIT_FAILURE;
+    }
+
+    if (InitShards() == false)
+    {
+        fprintf(stderr, "No memory for shards\n");
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i != nWorkerCount; ++i)
+    {
+        g_Workers[i].nEpoll = epoll_create1(0);
+        if (g_Workers[i].nEpoll == -1
+            || pthread_create(&g_Workers[i].Thread, NULL, WorkerMain, &g_Workers[i]) != 0)
+        {
+            perror("Worker");
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("Listening on %s with %d workers\n", lpSocketPath, nWorkerCount);
+    fflush(stdout);
+
+    // Accept connections and spread them over workers
+    int nReserve = open("/dev/null", O_RDONLY);
+    for (size_t nNext = 0;; nNext = (nNext + 1) % (size_t)nWorkerCount)
+    {
+        int nSocket = AcceptConnection(nListen, &nReserve);
+        if (nSocket == -1)
+        {
+            continue;
+        }
+
+        Connection *lpConnection = calloc(1, sizeof(Connection));
+        if (lpConnection == NULL)
+        {
+            close(nSocket);
+            continue;
+        }
+
+        lpConnection->nSocket = nSocket;
+        lpConnection->nEvents = EPOLLIN;
+        fcntl(nSocket, F_SETFL, fcntl(nSocket, F_GETFL, 0) | O_NONBLOCK);
+
+        struct epoll_event Event = { 0 };
+        Event.events = EPOLLIN;
+        Event.data.ptr = lpConnection;
+        if (epoll_ctl(g_Workers[nNext].nEpoll, EPOLL_CTL_ADD, nSocket, &Event) == -1)
+        {
+            CloseConnection(lpConnection);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
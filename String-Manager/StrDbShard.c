@@ -0,0 +1,492 @@
+/******************************************************
+ - FileName
+    StrDbShard.c
+ - Description
+    Sharded front end of string database
+*******************************************************/
+#include "StrDbShard.h"
+#include "StrDb.h"
+#include "StrDbCodec.h"
+#include <stdlib.h>
+#include <wchar.h>
+#include <assert.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef SRWLOCK         ShardLock;
+#else
+#include <pthread.h>
+typedef pthread_mutex_t ShardLock;
+#endif
+
+// Encode and decode string handle, it holds string id in shard
+#define MAKE_HANDLE(nShard, nId)        (((nId) << SHARD_BITS) | (nShard))
+#define HANDLE_SHARD(hItem)             ((hItem) & (SHARD_COUNT - 1))
+#define HANDLE_ID(hItem)                ((hItem) >> SHARD_BITS)
+
+/*
+    A shard owns a database, guarded by its lock
+*/
+typedef struct _Shard
+{
+    Database *lpDatabase;
+    ShardLock Lock;
+} Shard;
+
+static Shard g_Shards[SHARD_COUNT] = { 0 };
+
+/*
+    Get the shard of string content. Strings are routed by normalized
+    content, so strings equal in any query mode are in the same shard
+*/
+static size_t ShardOf(const wchar_t *lpString)
+{
+    assert(lpString != NULL);
+
+    uint32_t nHash = HashFoldedString(lpString, wcslen(lpString), true);
+
+    // Mix high bits down, low bits of FNV are weak
+    return (nHash ^ (nHash >> 16)) & (SHARD_COUNT - 1);
+}
+
+/*
+    Lock a shard and select its database for current thread
+*/
+static Database *EnterShard(size_t nShard)
+{
+    assert(nShard < SHARD_COUNT);
+
+#ifdef _WIN32
+    AcquireSRWLockExclusive(&g_Shards[nShard].Lock);
+#else
+    pthread_mutex_lock(&g_Shards[nShard].Lock);
+#endif
+
+    return SelectDatabase(g_Shards[nShard].lpDatabase);
+}
+
+/*
+    Restore the database selected before, and unlock a shard
+*/
+static void LeaveShard(size_t nShard, Database *lpPrevious)
+{
+    assert(nShard < SHARD_COUNT);
+
+    SelectDatabase(lpPrevious);
+
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(&g_Shards[nShard].Lock);
+#else
+    pthread_mutex_unlock(&g_Shards[nShard].Lock);
+#endif
+}
+
+/*
+    Lock two different shards, always in the same order to avoid deadlock
+*/
+static Database *EnterShardPair(size_t nFirst, size_t nSecond)
+{
+    assert(nFirst != nSecond);
+
+    Database *lpPrevious = EnterShard((nFirst < nSecond) ? nFirst : nSecond);
+    EnterShard((nFirst < nSecond) ? nSecond : nFirst);
+    return lpPrevious;
+}
+
+/*
+    Unlock two shards locked by EnterShardPair
+*/
+static void LeaveShardPair(size_t nFirst, size_t nSecond, Database *lpPrevious)
+{
+    LeaveShard((nFirst < nSecond) ? nSecond : nFirst, lpPrevious);
+    LeaveShard((nFirst < nSecond) ? nFirst : nSecond, lpPrevious);
+}
+
+/*
+    Create databases and locks of all shards
+*/
+bool InitShards()
+{
+    for (size_t i = 0; i != SHARD_COUNT; ++i)
+    {
+        g_Shards[i].lpDatabase = CreateDatabase();
+        if (g_Shards[i].lpDatabase == NULL)
+        {
+            ReleaseShards();
+            return false;
+        }
+
+#ifdef _WIN32
+        InitializeSRWLock(&g_Shards[i].Lock);
+#else
+        pthread_mutex_init(&g_Shards[i].Lock, NULL);
+#endif
+    }
+
+    return true;
+}
+
+/*
+    Destroy databases and locks of all shards
+*/
+void ReleaseShards()
+{
+    for (size_t i = 0; i != SHARD_COUNT; ++i)
+    {
+        if (g_Shards[i].lpDatabase != NULL)
+        {
+            DestroyDatabase(g_Shards[i].lpDatabase);
+            g_Shards[i].lpDatabase = NULL;
+
+#ifndef _WIN32
+            pthread_mutex_destroy(&g_Shards[i].Lock);
+#endif
+        }
+    }
+}
+
+/*
+    Store string to the shard of its content
+*/
+bool ShardStore(const wchar_t *lpString, ShardHandle *lpHandle)
+{
+    assert(lpString != NULL);
+
+    size_t nShard = ShardOf(lpString), nIndex = 0;
+    Database *lpPrevious = EnterShard(nShard);
+    bool bResult = Store(lpString, &nIndex);
+    if (bResult == true && lpHandle != NULL)
+    {
+        *lpHandle = MAKE_HANDLE(nShard, GetItemId(nIndex));
+    }
+
+    LeaveShard(nShard, lpPrevious);
+
+    return bResult;
+}
+
+/*
+    Copy string by handle
+*/
+size_t ShardQueryByHandle(ShardHandle hItem, wchar_t *lpBuffer, size_t nBufferSize)
+{
+    size_t nShard = HANDLE_SHARD(hItem), nLength = 0;
+    Database *lpPrevious = EnterShard(nShard);
+    const wchar_t *lpString = QueryByIndex(GetIndexById(HANDLE_ID(hItem)), &nLength);
+    if (lpString != NULL && lpBuffer != NULL && nLength <= nBufferSize)
+    {
+        wmemcpy(lpBuffer, lpString, nLength);
+    }
+
+    LeaveShard(nShard, lpPrevious);
+    return nLength;
+}
+
+/*
+    Query all strings by content in the shard of content
+*/
+size_t ShardQueryAllByContent(const wchar_t *lpString,
+    ShardHandle *lpHandles, size_t nMaxCount)
+{
+    return ShardQueryAllByContentEx(lpString, QUERY_MODE_EXACT, lpHandles, nMaxCount);
+}
+
+/*
+    Query all strings by content in a query mode
+*/
+size_t ShardQueryAllByContentEx(const wchar_t *lpString, int nMode,
+    ShardHandle *lpHandles, size_t nMaxCount)
+{
+    assert(lpString != NULL);
+    assert(lpHandles != NULL || nMaxCount == 0);
+
+    size_t nShard = ShardOf(lpString), nMatchCount = 0;
+    Database *lpPrevious = EnterShard(nShard);
+    const QueryRecord *lpRecords = QueryAllByContentEx(lpString, nMode, &nMatchCount);
+    for (size_t i = 0; i != nMatchCount && i != nMaxCount; ++i)
+    {
+        lpHandles[i] = MAKE_HANDLE(nShard, GetItemId(lpRecords[i].nIndex));
+    }
+
+    LeaveShard(nShard, lpPrevious);
+    return nMatchCount;
+}
+
+/*
+    Fuzzy query all strings by content in all shards
+*/
+size_t ShardFuzzyQueryAllByContent(const wchar_t *lpString,
+    ShardHandle *lpHandles, size_t nMaxCount)
+{
+    return ShardFuzzyQueryAllByContentEx(lpString, QUERY_MODE_EXACT, lpHandles, nMaxCount);
+}
+
+/*
+    Fuzzy query all strings by content in all shards in a query mode
+*/
+size_t ShardFuzzyQueryAllByContentEx(const wchar_t *lpString, int nMode,
+    ShardHandle *lpHandles, size_t nMaxCount)
+{
+    assert(lpString != NULL);
+    assert(lpHandles != NULL || nMaxCount == 0);
+
+    // Substring can be in any shard, scatter to all and gather results
+    size_t nTotalCount = 0;
+    for (size_t nShard = 0; nShard != SHARD_COUNT; ++nShard)
+    {
+        size_t nMatchCount = 0;
+        Database *lpPrevious = EnterShard(nShard);
+        const QueryRecord *lpRecords = FuzzyQueryAllByContentEx(lpString, nMode, &nMatchCount);
+        for (size_t i = 0; i != nMatchCount && nTotalCount + i < nMaxCount; ++i)
+        {
+            lpHandles[nTotalCount + i] = MAKE_HANDLE(nShard, GetItemId(lpRecords[i].nIndex));
+        }
+
+        LeaveShard(nShard, lpPrevious);
+        nTotalCount += nMatchCount;
+    }
+
+    return nTotalCount;
+}
+
+/*
+    Delete string by handle
+*/
+bool ShardDeleteByHandle(ShardHandle hItem)
+{
+    size_t nShard = HANDLE_SHARD(hItem);
+    Database *lpPrevious = EnterShard(nShard);
+    bool bResult = DeleteByIndex(GetIndexById(HANDLE_ID(hItem)));
+    LeaveShard(nShard, lpPrevious);
+    return bResult;
+}
+
+/*
+    Delete all matched string by content
+*/
+size_t ShardDeleteAllByContent(const wchar_t *lpString)
+{
+    assert(lpString != NULL);
+
+    size_t nShard = ShardOf(lpString);
+    Database *lpPrevious = EnterShard(nShard);
+    size_t nDeleteCount = DeleteAllByContent(lpString);
+    LeaveShard(nShard, lpPrevious);
+    return nDeleteCount;
+}
+
+/*
+    Alter string by handle
+*/
+bool ShardAlterByHandle(ShardHandle hItem,
+    const wchar_t *lpNewString, ShardHandle *lpNewHandle)
+{
+    assert(lpNewString != NULL);
+
+    size_t nSrcShard = HANDLE_SHARD(hItem), nNewShard = ShardOf(lpNewString);
+    size_t nNewId = 0;
+    bool bResult = false;
+    if (nSrcShard == nNewShard)
+    {
+        size_t nNewIndex = 0;
+        Database *lpPrevious = EnterShard(nSrcShard);
+        bResult = AlterByIndex(GetIndexById(HANDLE_ID(hItem)), lpNewString, &nNewIndex);
+        nNewId = (bResult == true) ? GetItemId(nNewIndex) : 0;
+        LeaveShard(nSrcShard, lpPrevious);
+    }
+    else
+    {
+        // Store to new shard first, source is kept if there is no space
+        Database *lpPrevious = EnterShardPair(nSrcShard, nNewShard);
+        SelectDatabase(g_Shards[nSrcShard].lpDatabase);
+        size_t nSrcIndex = GetIndexById(HANDLE_ID(hItem)), nNewIndex = 0;
+        if (nSrcIndex != SIZE_MAX)
+        {
+            SelectDatabase(g_Shards[nNewShard].lpDatabase);
+            bResult = Store(lpNewString, &nNewIndex);
+            if (bResult == true)
+            {
+                nNewId = GetItemId(nNewIndex);
+                SelectDatabase(g_Shards[nSrcShard].lpDatabase);
+                DeleteByIndex(nSrcIndex);
+            }
+        }
+
+        LeaveShardPair(nSrcShard, nNewShard, lpPrevious);
+    }
+
+    if (bResult == true && lpNewHandle != NULL)
+    {
+        *lpNewHandle = MAKE_HANDLE(nNewShard, nNewId);
+    }
+
+    return bResult;
+}
+
+/*
+    Alter all matched string by content
+*/
+size_t ShardAlterAllByContent(const wchar_t *lpSrcString, const wchar_t *lpNewString)
+{
+    assert(lpSrcString != NULL);
+    assert(lpNewString != NULL);
+
+    size_t nSrcShard = ShardOf(lpSrcString), nNewShard = ShardOf(lpNewString);
+    size_t nAlterCount = 0;
+    if (nSrcShard == nNewShard)
+    {
+        Database *lpPrevious = EnterShard(nSrcShard);
+        nAlterCount = AlterAllByContent(lpSrcString, lpNewString);
+        LeaveShard(nSrcShard, lpPrevious);
+    }
+    else
+    {
+        // All new strings are stored before any matched string is deleted,
+        // and they are deleted by ids if new shard is full
+        Database *lpPrevious = EnterShardPair(nSrcShard, nNewShard);
+        SelectDatabase(g_Shards[nSrcShard].lpDatabase);
+        size_t nMatchCount = 0, nMatchIndex = 0;
+        while (QueryNextByContent(lpSrcString, nMatchIndex, &nMatchIndex) != NULL)
+        {
+            ++nMatchCount;
+            ++nMatchIndex;
+        }
+
+        // One more id, so that nothing matched is not out of memory
+        size_t *lpNewIds = malloc((nMatchCount + 1) * sizeof(size_t));
+        size_t nStoreCount = 0;
+        if (lpNewIds != NULL)
+        {
+            SelectDatabase(g_Shards[nNewShard].lpDatabase);
+            size_t nNewIndex = 0;
+            while (nStoreCount != nMatchCount && Store(lpNewString, &nNewIndex) == true)
+            {
+                lpNewIds[nStoreCount++] = GetItemId(nNewIndex);
+            }
+        }
+
+        if (lpNewIds != NULL && nStoreCount == nMatchCount)
+        {
+            SelectDatabase(g_Shards[nSrcShard].lpDatabase);
+            nAlterCount = DeleteAllByContent(lpSrcString);
+        }
+        else
+        {
+            for (size_t i = 0; i != nStoreCount; ++i)
+            {
+                DeleteByIndex(GetIndexById(lpNewIds[i]));
+            }
+
+            nAlterCount = SIZE_MAX;
+        }
+
+        free(lpNewIds);
+        LeaveShardPair(nSrcShard, nNewShard, lpPrevious);
+    }
+
+    return nAlterCount;
+}
+
+/*
+    Count the number and frequency of '0'~'9', 'A'~'Z' and 'a'~'z'
+    in all shards
+*/
+bool ShardStatistic(size_t *lpCounts, size_t nSize, size_t *lpTotal)
+{
+    assert(lpCounts != NULL);
+
+    // Counts are accumulated shard by shard
+    size_t nTotal = 0;
+    for (size_t nShard = 0; nShard != SHARD_COUNT; ++nShard)
+    {
+        size_t nShardTotal = 0;
+        Database *lpPrevious = EnterShard(nShard);
+        bool bResult = Statistic(lpCounts, nSize, &nShardTotal);
+        LeaveShard(nShard, lpPrevious);
+
+        if (bResult == false)
+        {
+            return false;
+        }
+
+        nTotal += nShardTotal;
+    }
+
+    if (lpTotal != NULL)
+    {
+        *lpTotal = nTotal;
+    }
+
+    return true;
+}
+
+/*
+    Convert an id of shard to handle, SIZE_MAX is kept
+*/
+static size_t HandleOfId(size_t nShard, size_t nId)
+{
+    return (nId != SIZE_MAX) ? MAKE_HANDLE(nShard, nId) : SIZE_MAX;
+}
+
+/*
+    Get sequence number of the latest change event of a shard
+*/
+size_t ShardGetChangeSequence(size_t nShard)
+{
+    assert(nShard < SHARD_COUNT);
+
+    Database *lpPrevious = SelectDatabase(g_Shards[nShard].lpDatabase);
+    size_t nSequence = GetChangeSequence();
+    SelectDatabase(lpPrevious);
+    return nSequence;
+}
+
+/*
+    Read change events of a shard after a cursor, without lock
+*/
+size_t ShardReadChanges(size_t nShard, size_t nCursor, ChangeEvent *lpEvents, size_t nMaxCount)
+{
+    assert(nShard < SHARD_COUNT);
+
+    Database *lpPrevious = SelectDatabase(g_Shards[nShard].lpDatabase);
+    size_t nCount = ReadChanges(nCursor, lpEvents, nMaxCount);
+    SelectDatabase(lpPrevious);
+
+    for (size_t i = 0; nCount != CHANGE_CURSOR_LOST && i != nCount; ++i)
+    {
+        lpEvents[i].nId = HandleOfId(nShard, lpEvents[i].nId);
+        lpEvents[i].nPreviousId = HandleOfId(nShard, lpEvents[i].nPreviousId);
+    }
+
+    return nCount;
+}
+
+/*
+    Read the whole string stored or altered by a change event of a shard
+*/
+bool ShardReadChangeData(size_t nShard, const ChangeEvent *lpEvent, wchar_t *lpBuffer)
+{
+    assert(nShard < SHARD_COUNT);
+
+    Database *lpPrevious = SelectDatabase(g_Shards[nShard].lpDatabase);
+    bool bResult = ReadChangeData(lpEvent, lpBuffer);
+    SelectDatabase(lpPrevious);
+    return bResult;
+}
+
+/*
+    Copy all strings of a shard with their handles under its lock
+*/
+Snapshot *ShardTakeSnapshot(size_t nShard)
+{
+    Database *lpPrevious = EnterShard(nShard);
+    Snapshot *lpSnapshot = TakeSnapshot();
+    LeaveShard(nShard, lpPrevious);
+
+    for (size_t i = 0; lpSnapshot != NULL && i != lpSnapshot->nCount; ++i)
+    {
+        lpSnapshot->lpIds[i] = HandleOfId(nShard, lpSnapshot->lpIds[i]);
+    }
+
+    return lpSnapshot;
+}
@@ -0,0 +1,235 @@
+/******************************************************
+ - FileName
+    StrDbShard.h
+ - Description
+    Sharded front end of string database, strings are
+    routed to shards by content hash, each shard has
+    its own database and lock, so threads can write
+    to different shards at the same time
+*******************************************************/
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include "StrDb.h"
+
+// Number of shards, must be power of 2
+#define SHARD_BITS      3
+#define SHARD_COUNT     (1 << SHARD_BITS)
+
+/*
+    Global handle of string, encodes its shard and id in shard.
+    It is not shifted by storing or deleting other strings, and
+    is invalid once the string is deleted or moved
+*/
+typedef size_t ShardHandle;
+
+/*
+ - Description
+    Create databases and locks of all shards
+ - Return
+    true if successful, or false
+*/
+bool InitShards();
+
+/*
+    Destroy databases and locks of all shards
+*/
+void ReleaseShards();
+
+/*
+ - Description
+    Store string to the shard of its content
+ - Input
+    lpString: The string to store
+ - Output
+    lpHandle: String handle. It can be NULL
+ - Return
+    true if successful, or false
+*/
+bool ShardStore(const wchar_t *lpString, ShardHandle *lpHandle);
+
+/*
+ - Description
+    Copy string by handle, the string can be changed by other
+    threads once the shard is unlocked, so it is copied out
+ - Input
+    hItem: The handle of string
+    nBufferSize: The buffer size in characters
+ - Output
+    lpBuffer: The string copied, if buffer is large enough. It can be NULL
+ - Return
+    Number of characters in string, including '\0', or 0 if not found
+*/
+size_t ShardQueryByHandle(ShardHandle hItem, wchar_t *lpBuffer, size_t nBufferSize);
+
+/*
+ - Description
+    Query all strings by content, only the shard of content is searched
+ - Input
+    lpString: The string to query
+    nMaxCount: The max count of handles to output
+ - Output
+    lpHandles: The matched string handles
+ - Return
+    The matched strings count, it can be more than nMaxCount
+*/
+size_t ShardQueryAllByContent(const wchar_t *lpString,
+    ShardHandle *lpHandles, size_t nMaxCount);
+
+/*
+ - Description
+    Query all strings by content in a query mode. Strings are routed by
+    normalized content, so only the shard of content is searched
+ - Input
+    lpString: The string to query
+    nMode: The query mode, QUERY_MODE_*
+    nMaxCount: The max count of handles to output
+ - Output
+    lpHandles: The matched string handles
+ - Return
+    The matched strings count, it can be more than nMaxCount
+*/
+size_t ShardQueryAllByContentEx(const wchar_t *lpString, int nMode,
+    ShardHandle *lpHandles, size_t nMaxCount);
+
+/*
+ - Description
+    Fuzzy query all strings by content in all shards
+ - Input
+    lpString: The string to query
+    nMaxCount: The max count of handles to output
+ - Output
+    lpHandles: The matched string handles
+ - Return
+    The matched strings count, it can be more than nMaxCount
+*/
+size_t ShardFuzzyQueryAllByContent(const wchar_t *lpString,
+    ShardHandle *lpHandles, size_t nMaxCount);
+
+/*
+ - Description
+    Fuzzy query all strings by content in all shards in a query mode
+ - Input
+    lpString: The string to query
+    nMode: The query mode, QUERY_MODE_*
+    nMaxCount: The max count of handles to output
+ - Output
+    lpHandles: The matched string handles
+ - Return
+    The matched strings count, it can be more than nMaxCount
+*/
+size_t ShardFuzzyQueryAllByContentEx(const wchar_t *lpString, int nMode,
+    ShardHandle *lpHandles, size_t nMaxCount);
+
+/*
+ - Description
+    Delete string by handle
+ - Input
+    hItem: The handle of string
+ - Return
+    true if successful, or false
+*/
+bool ShardDeleteByHandle(ShardHandle hItem);
+
+/*
+ - Description
+    Delete all matched string by content
+ - Input
+    lpString: The string to delete
+ - Return
+    The deleted strings count
+*/
+size_t ShardDeleteAllByContent(const wchar_t *lpString);
+
+/*
+ - Description
+    Alter string by handle, the string is moved to another shard
+    if the shard of new content is different
+ - Input
+    hItem: The handle of source string
+    lpNewString: The new string
+ - Output
+    lpNewHandle: The new string handle. It can be NULL
+ - Return
+    true if successful, or false
+*/
+bool ShardAlterByHandle(ShardHandle hItem,
+    const wchar_t *lpNewString, ShardHandle *lpNewHandle);
+
+/*
+ - Description
+    Alter all matched string by content. If new string is in another
+    shard, either all matched strings are altered or none is
+ - Input
+    lpSrcString: The source string
+    lpNewString: The new string
+ - Return
+    The altered strings count, or SIZE_MAX if new shard has no space
+    for all of them and nothing is altered
+*/
+size_t ShardAlterAllByContent(const wchar_t *lpSrcString, const wchar_t *lpNewString);
+
+/*
+ - Description
+    Count the number and frequency of '0'~'9', 'A'~'Z' and 'a'~'z'
+    in all shards
+ - Input
+    lpCounts: The array to store counts
+    nSize: The array size, minimum size is 62
+ - Output
+    lpTotal: The total letters count. It can be NULL
+ - Return
+    true if successful, or false
+*/
+bool ShardStatistic(size_t *lpCounts, size_t nSize, size_t *lpTotal);
+
+/*
+ - Description
+    Get sequence number of the latest change event of a shard
+ - Input
+    nShard: The shard, less than SHARD_COUNT
+ - Return
+    The latest sequence number, 0 if there is no change
+*/
+size_t ShardGetChangeSequence(size_t nShard);
+
+/*
+ - Description
+    Read change events of a shard after a cursor, without lock. Ids of
+    events are handles, and SIZE_MAX is kept
+ - Input
+    nShard: The shard, less than SHARD_COUNT
+    nCursor: Sequence number of the last event read
+    nMaxCount: The max count of events to read
+ - Output
+    lpEvents: The events read, in sequence
+ - Return
+    Number of events read, or CHANGE_CURSOR_LOST if events after cursor
+    are overwritten, then a snapshot must be taken again
+*/
+size_t ShardReadChanges(size_t nShard, size_t nCursor, ChangeEvent *lpEvents, size_t nMaxCount);
+
+/*
+ - Description
+    Read the whole string stored or altered by a change event of a shard
+ - Input
+    nShard: The shard the event is read from
+    lpEvent: The event read by ShardReadChanges
+ - Output
+    lpBuffer: The string, buffer size is at least nLength of event
+ - Return
+    true if successful, or false if the string is overwritten
+*/
+bool ShardReadChangeData(size_t nShard, const ChangeEvent *lpEvent, wchar_t *lpBuffer);
+
+/*
+ - Description
+    Copy all strings of a shard with their handles under its lock,
+    then read changes of the shard from the sequence of snapshot.
+    Ids of snapshot are handles
+ - Input
+    nShard: The shard, less than SHARD_COUNT
+ - Return
+    The snapshot, freed by FreeSnapshot, or NULL if out of memory
+*/
+Snapshot *ShardTakeSnapshot(size_t nShard);
@@ -0,0 +1,152 @@
+/******************************************************
+ - FileName
+    StrDbShardBench.c
+ - Description
+    Store benchmark of sharded front end. Threads
+    store and delete strings in shards at the same
+    time, once with keys spread over all shards and
+    once with one key routed to one shard, then
+    stores per second of each thread count are
+    reported
+ - Usage
+    StrDbShardBench [MaxThreads] [Stores]
+*******************************************************/
+#include "StrDbShard.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <wchar.h>
+#include <time.h>
+#include <pthread.h>
+
+#define DEFAULT_MAX_THREADS     8
+#define DEFAULT_STORES          200000
+
+// Strings each thread keeps stored, so that shards never fill up
+#define WINDOW_SIZE             8
+
+/*
+    Load of a thread and its result
+*/
+typedef struct _Worker
+{
+    pthread_t Thread;
+    size_t nIndex;          // Thread number
+    size_t nStores;         // Stores to do
+    bool bSpread;           // Whether keys are spread over shards
+    size_t nFailed;         // Stores not successful
+} Worker;
+
+/*
+    Get monotonic time in nanoseconds
+*/
+static uint64_t Now()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (uint64_t)Time.tv_sec * 1000000000u + (uint64_t)Time.tv_nsec;
+}
+
+/*
+    Worker thread, stores a key and deletes the one stored WINDOW_SIZE ago
+*/
+static void *WorkerMain(void *lpParam)
+{
+    Worker *lpWorker = lpParam;
+    ShardHandle Window[WINDOW_SIZE] = { 0 };
+    bool bStored[WINDOW_SIZE] = { false };
+    for (size_t i = 0; i != lpWorker->nStores; ++i)
+    {
+        wchar_t szKey[32];
+        if (lpWorker->bSpread == true)
+        {
+            swprintf(szKey, 32, L"k%zu-%zu", lpWorker->nIndex, i % 64);
+        }
+        else
+        {
+            swprintf(szKey, 32, L"hot-key");
+        }
+
+        size_t nSlot = i % WINDOW_SIZE;
+        if (bStored[nSlot] == true)
+        {
+            ShardDeleteByHandle(Window[nSlot]);
+        }
+
+        bStored[nSlot] = ShardStore(szKey, &Window[nSlot]);
+        if (bStored[nSlot] == false)
+        {
+            ++lpWorker->nFailed;
+        }
+    }
+
+    for (size_t i = 0; i != WINDOW_SIZE; ++i)
+    {
+        if (bStored[i] == true)
+        {
+            ShardDeleteByHandle(Window[i]);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+    Run threads storing at the same time, returns stores per second
+*/
+static double RunWorkers(size_t nThreads, size_t nStores, bool bSpread, size_t *lpFailed)
+{
+    Worker Workers[64] = { 0 };
+    uint64_t nBegin = Now();
+    for (size_t i = 0; i != nThreads; ++i)
+    {
+        Workers[i].nIndex = i;
+        Workers[i].nStores = nStores / nThreads;
+        Workers[i].bSpread = bSpread;
+        pthread_create(&Workers[i].Thread, NULL, WorkerMain, &Workers[i]);
+    }
+
+    *lpFailed = 0;
+    for (size_t i = 0; i != nThreads; ++i)
+    {
+        pthread_join(Workers[i].Thread, NULL);
+        *lpFailed += Workers[i].nFailed;
+    }
+
+    double dSeconds = (double)(Now() - nBegin) / 1e9;
+    return (double)(nStores / nThreads * nThreads) / dSeconds;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t nMaxThreads = (argc > 1) ? strtoul(argv[1], NULL, 10) : DEFAULT_MAX_THREADS;
+    size_t nStores = (argc > 2) ? strtoul(argv[2], NULL, 10) : DEFAULT_STORES;
+    if (nMaxThreads == 0 || nMaxThreads > 64 || nStores == 0)
+    {
+        fprintf(stderr, "Usage: %s [MaxThreads(1~64)] [Stores]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (InitShards() == false)
+    {
+        fprintf(stderr, "Shards can not be created\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Threads  Spread stores/s  One shard stores/s\n");
+    for (size_t nThreads = 1; nThreads <= nMaxThreads; nThreads *= 2)
+    {
+        size_t nSpreadFailed = 0, nOneFailed = 0;
+        double dSpread = RunWorkers(nThreads, nStores, true, &nSpreadFailed);
+        double dOne = RunWorkers(nThreads, nStores, false, &nOneFailed);
+        printf("%7zu  %15.0f  %18.0f\n", nThreads, dSpread, dOne);
+        if (nSpreadFailed != 0 || nOneFailed != 0)
+        {
+            fprintf(stderr, "%zu stores not successful\n", nSpreadFailed + nOneFailed);
+        }
+    }
+
+    ReleaseShards();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,272 @@
+/**************************************************
+ - FileName
+    StrDbSketch.c
+ - Description
+    Bounded memory sketches of string database
+***************************************************/
+#include "StrDbSketch.h"
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+/*
+    Hash key characters, FNV-1a mixed by SplitMix64 finalizer,
+    so that all bits can be used by HyperLogLog
+*/
+static uint64_t HashKey(const wchar_t *lpKey, size_t nLength)
+{
+    uint64_t nHash = 14695981039346656037u;
+    for (size_t i = 0; i != nLength; ++i)
+    {
+        nHash = (nHash ^ (uint64_t)lpKey[i]) * 1099511628211u;
+    }
+
+    nHash = (nHash ^ (nHash >> 30)) * 0xBF58476D1CE4E5B9u;
+    nHash = (nHash ^ (nHash >> 27)) * 0x94D049BB133111EBu;
+    return nHash ^ (nHash >> 31);
+}
+
+/*
+    Get the counter of a row, rows are hashed by double hashing
+*/
+static size_t CounterOf(uint64_t nHash, size_t nRow)
+{
+    uint32_t nFirst = (uint32_t)nHash, nSecond = (uint32_t)(nHash >> 32) | 1;
+    return (size_t)((nFirst + (uint32_t)nRow * nSecond) % SKETCH_WIDTH);
+}
+
+/*
+    Increase or decrease counters of a key, returns the new estimated count
+*/
+static size_t UpdateCountMin(CountMinSketch *lpSketch, uint64_t nHash, bool bIncrease)
+{
+    uint32_t nEstimate = UINT32_MAX;
+    for (size_t i = 0; i != SKETCH_DEPTH; ++i)
+    {
+        uint32_t *lpCounter = &lpSketch->nCounters[i][CounterOf(nHash, i)];
+        if (bIncrease == true)
+        {
+            ++*lpCounter;
+        }
+        else if (*lpCounter != 0)
+        {
+            --*lpCounter;
+        }
+
+        nEstimate = (*lpCounter < nEstimate) ? *lpCounter : nEstimate;
+    }
+
+    return nEstimate;
+}
+
+/*
+    Get the estimated count of a key
+*/
+static size_t QueryCountMin(const CountMinSketch *lpSketch, uint64_t nHash)
+{
+    uint32_t nEstimate = UINT32_MAX;
+    for (size_t i = 0; i != SKETCH_DEPTH; ++i)
+    {
+        uint32_t nCounter = lpSketch->nCounters[i][CounterOf(nHash, i)];
+        nEstimate = (nCounter < nEstimate) ? nCounter : nEstimate;
+    }
+
+    return nEstimate;
+}
+
+/*
+    Update the count of a candidate, an increased key replaces the
+    candidate with the least count if its count is larger
+*/
+static void UpdateHeavyHitters(HeavyHitterList *lpList, uint64_t nHash,
+    const wchar_t *lpKey, size_t nLength, size_t nCount, bool bIncrease)
+{
+    HeavyHitter *lpVictim = NULL;
+    for (size_t i = 0; i != lpList->nCount; ++i)
+    {
+        HeavyHitter *lpItem = &lpList->Items[i];
+        if (lpItem->nHash == nHash && lpItem->nLength == nLength)
+        {
+            if (nCount != 0)
+            {
+                lpItem->nCount = nCount;
+            }
+            else
+            {
+                // Not counted any more, fill the hole by the last one
+                *lpItem = lpList->Items[--lpList->nCount];
+            }
+
+            return;
+        }
+        else if (lpVictim == NULL || lpItem->nCount < lpVictim->nCount)
+        {
+            lpVictim = lpItem;
+        }
+    }
+
+    if (bIncrease == false)
+    {
+        return;
+    }
+    else if (lpList->nCount != TOP_K_COUNT)
+    {
+        lpVictim = &lpList->Items[lpList->nCount++];
+    }
+    else if (lpVictim == NULL || nCount <= lpVictim->nCount)
+    {
+        return;
+    }
+
+    size_t nKeyLength = (nLength < FREQUENT_ITEM_LENGTH) ? nLength : FREQUENT_ITEM_LENGTH - 1;
+    lpVictim->nHash = nHash;
+    lpVictim->nCount = nCount;
+    lpVictim->nLength = nLength;
+    memcpy(lpVictim->szKey, lpKey, nKeyLength * sizeof(wchar_t));
+    lpVictim->szKey[nKeyLength] = L'\0';
+}
+
+/*
+    Raise the register of a key
+*/
+static void AddToHyperLogLog(HyperLogLog *lpDistinct, uint64_t nHash)
+{
+    size_t nRegister = (size_t)(nHash >> (64 - HLL_BITS));
+    uint64_t nRest = nHash << HLL_BITS;
+    uint8_t nRank = 1;
+    while (nRank <= 64 - HLL_BITS && (nRest & (1ull << 63)) == 0)
+    {
+        nRest <<= 1;
+        ++nRank;
+    }
+
+    uint8_t *lpRegister = &lpDistinct->nRegisters[nRegister];
+    if (nRank > *lpRegister)
+    {
+        if (*lpRegister == 0)
+        {
+            ++lpDistinct->nNonZeroCount;
+        }
+        else
+        {
+            lpDistinct->dNonZeroSum -= ldexp(1.0, -(int)*lpRegister);
+        }
+
+        lpDistinct->dNonZeroSum += ldexp(1.0, -(int)nRank);
+        *lpRegister = nRank;
+    }
+}
+
+/*
+    Count or uncount n-grams of a string
+*/
+static void UpdateGrams(SketchSet *lpSketches, const wchar_t *lpString,
+    size_t nLength, bool bIncrease)
+{
+    for (size_t nGramLength = 2; nGramLength <= 3; ++nGramLength)
+    {
+        HeavyHitterList *lpList = (nGramLength == 2) ?
+            &lpSketches->FrequentBigrams : &lpSketches->FrequentTrigrams;
+        for (size_t i = 0; i + nGramLength <= nLength; ++i)
+        {
+            uint64_t nHash = HashKey(&lpString[i], nGramLength);
+            size_t nCount = UpdateCountMin(&lpSketches->GramCounts, nHash, bIncrease);
+            UpdateHeavyHitters(lpList, nHash, &lpString[i], nGramLength, nCount, bIncrease);
+        }
+    }
+}
+
+/*
+    Count a string and its bigrams and trigrams in sketches
+*/
+void AddToSketches(SketchSet *lpSketches, const wchar_t *lpString, size_t nLength)
+{
+    assert(lpSketches != NULL);
+    assert(lpString != NULL);
+
+    uint64_t nHash = HashKey(lpString, nLength);
+    size_t nCount = UpdateCountMin(&lpSketches->StringCounts, nHash, true);
+    UpdateHeavyHitters(&lpSketches->FrequentStrings, nHash, lpString, nLength, nCount, true);
+    AddToHyperLogLog(&lpSketches->Distinct, nHash);
+    UpdateGrams(lpSketches, lpString, nLength, true);
+}
+
+/*
+    Uncount a string and its n-grams
+*/
+void RemoveFromSketches(SketchSet *lpSketches, const wchar_t *lpString, size_t nLength)
+{
+    assert(lpSketches != NULL);
+    assert(lpString != NULL);
+
+    uint64_t nHash = HashKey(lpString, nLength);
+    size_t nCount = UpdateCountMin(&lpSketches->StringCounts, nHash, false);
+    UpdateHeavyHitters(&lpSketches->FrequentStrings, nHash, lpString, nLength, nCount, false);
+    UpdateGrams(lpSketches, lpString, nLength, false);
+}
+
+/*
+    Estimate the count of a string
+*/
+size_t EstimateCount(const SketchSet *lpSketches, const wchar_t *lpString, size_t nLength)
+{
+    assert(lpSketches != NULL);
+    assert(lpString != NULL);
+
+    return QueryCountMin(&lpSketches->StringCounts, HashKey(lpString, nLength));
+}
+
+/*
+    Copy frequent candidates sorted by count from high to low
+*/
+size_t GetHeavyHitters(const HeavyHitterList *lpList, FrequentItem *lpItems, size_t nMaxCount)
+{
+    assert(lpList != NULL);
+    assert(lpItems != NULL || nMaxCount == 0);
+
+    // Insertion sort, there are at most TOP_K_COUNT candidates
+    size_t nCount = 0;
+    for (size_t i = 0; i != lpList->nCount; ++i)
+    {
+        const HeavyHitter *lpItem = &lpList->Items[i];
+        size_t j = (nCount < nMaxCount) ? nCount++ : nMaxCount;
+        while (j != 0 && lpItems[j - 1].nCount < lpItem->nCount)
+        {
+            if (j < nMaxCount)
+            {
+                lpItems[j] = lpItems[j - 1];
+            }
+
+            --j;
+        }
+
+        if (j < nMaxCount)
+        {
+            memcpy(lpItems[j].szData, lpItem->szKey, sizeof(lpItem->szKey));
+            lpItems[j].nLength = lpItem->nLength;
+            lpItems[j].nCount = lpItem->nCount;
+        }
+    }
+
+    return nCount;
+}
+
+/*
+    Estimate distinct count by HyperLogLog
+*/
+size_t EstimateCardinality(const HyperLogLog *lpDistinct)
+{
+    assert(lpDistinct != NULL);
+
+    double dRegisters = HLL_REGISTER_COUNT;
+    size_t nZeroCount = HLL_REGISTER_COUNT - lpDistinct->nNonZeroCount;
+    double dSum = (double)nZeroCount + lpDistinct->dNonZeroSum;
+    double dEstimate = 0.7213 / (1 + 1.079 / dRegisters) * dRegisters * dRegisters / dSum;
+    if (dEstimate <= 2.5 * dRegisters && nZeroCount != 0)
+    {
+        // Linear counting is more accurate for small counts
+        dEstimate = dRegisters * log(dRegisters / (double)nZeroCount);
+    }
+
+    return (size_t)(dEstimate + 0.5);
+}
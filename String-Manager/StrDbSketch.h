@@ -0,0 +1,141 @@
+/**************************************************
+ - FileName
+    StrDbSketch.h
+ - Description
+    Bounded memory sketches of string database,
+    Count-Min sketches with top-K candidates for
+    frequent strings and n-grams, and HyperLogLog
+    for distinct strings count
+***************************************************/
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "StrDb.h"
+
+// Count-Min sketch overestimates a count by at most N / SKETCH_EPSILON_INVERSE
+// with probability 1 - e^-SKETCH_DEPTH, where N is the total count
+#define SKETCH_EPSILON_INVERSE  1000
+#define SKETCH_DEPTH            5
+
+// Counters of each row, e / epsilon
+#define SKETCH_WIDTH            (SKETCH_EPSILON_INVERSE * 2719 / 1000 + 1)
+
+// Number of frequent candidates kept
+#define TOP_K_COUNT             16
+
+// HyperLogLog has 2^HLL_BITS registers, standard error is 1.04 / sqrt(2^HLL_BITS)
+#define HLL_BITS                12
+#define HLL_REGISTER_COUNT      (1 << HLL_BITS)
+
+/*
+    Count-Min sketch, counts are increased and decreased by hashing
+    to a counter of each row, estimated count is the min of them
+*/
+typedef struct _CountMinSketch
+{
+    uint32_t nCounters[SKETCH_DEPTH][SKETCH_WIDTH];
+} CountMinSketch;
+
+/*
+    A frequent candidate, identified by hash of the whole key
+*/
+typedef struct _HeavyHitter
+{
+    uint64_t nHash;                         // Hash of key
+    size_t nCount;                          // Estimated count
+    size_t nLength;                         // Number of characters in key
+    wchar_t szKey[FREQUENT_ITEM_LENGTH];    // Key, cut if it is too long
+} HeavyHitter;
+
+/*
+    Candidates with the largest estimated counts
+*/
+typedef struct _HeavyHitterList
+{
+    HeavyHitter Items[TOP_K_COUNT];
+    size_t nCount;
+} HeavyHitterList;
+
+/*
+    HyperLogLog, registers are only raised, so it counts distinct
+    strings ever added. Sum of 2^-register is kept as registers change,
+    zeroed registers are not included so that zero memory is empty
+*/
+typedef struct _HyperLogLog
+{
+    uint8_t nRegisters[HLL_REGISTER_COUNT];
+    size_t nNonZeroCount;       // Number of registers not zero
+    double dNonZeroSum;         // Sum of 2^-register of registers not zero
+} HyperLogLog;
+
+/*
+    All sketches of a database
+*/
+typedef struct _SketchSet
+{
+    CountMinSketch StringCounts;
+    HeavyHitterList FrequentStrings;
+    CountMinSketch GramCounts;
+    HeavyHitterList FrequentBigrams;
+    HeavyHitterList FrequentTrigrams;
+    HyperLogLog Distinct;
+} SketchSet;
+
+/*
+ - Description
+    Count a string and its bigrams and trigrams in sketches
+ - Input
+    lpString: The string added
+    nLength: Number of characters in string, not including '\0'
+ - Output
+    lpSketches: The sketches
+*/
+void AddToSketches(SketchSet *lpSketches, const wchar_t *lpString, size_t nLength);
+
+/*
+ - Description
+    Uncount a string and its n-grams, which are counted before.
+    Distinct count is not decreased
+ - Input
+    lpString: The string removed
+    nLength: Number of characters in string, not including '\0'
+ - Output
+    lpSketches: The sketches
+*/
+void RemoveFromSketches(SketchSet *lpSketches, const wchar_t *lpString, size_t nLength);
+
+/*
+ - Description
+    Estimate the count of a string
+ - Input
+    lpSketches: The sketches
+    lpString: The string
+    nLength: Number of characters in string, not including '\0'
+ - Return
+    The estimated count, never less than the real count
+*/
+size_t EstimateCount(const SketchSet *lpSketches, const wchar_t *lpString, size_t nLength);
+
+/*
+ - Description
+    Copy frequent candidates sorted by count from high to low
+ - Input
+    lpList: The candidates
+    nMaxCount: The max count of items to output
+ - Output
+    lpItems: The frequent items
+ - Return
+    Number of items output
+*/
+size_t GetHeavyHitters(const HeavyHitterList *lpList, FrequentItem *lpItems, size_t nMaxCount);
+
+/*
+ - Description
+    Estimate distinct count by HyperLogLog
+ - Input
+    lpDistinct: The HyperLogLog
+ - Return
+    The estimated distinct count
+*/
+size_t EstimateCardinality(const HyperLogLog *lpDistinct);